@@ -0,0 +1,170 @@
+#include "billboard.h"
+#include "player.h"
+#include "renderer.h"
+#include <algorithm>
+#include <cmath>
+
+// Nearer than this is too close to draw
+static const float NEAR_DEPTH = 0.1f;
+
+// Slack on the visible-cell test for the blitter rounding sprite edges to
+// whole pixels, which at low resolutions is a fair part of a cell
+static const float VISIBLE_MARGIN = 0.25f;
+
+static Billboard billboards[MAX_BILLBOARDS];
+static int billboardCount = 0;
+static BillboardStats stats;
+
+// Positions and facings, one array each, so the camera-space pass is a
+// plain loop over floats the compiler can vectorise
+static float posX[MAX_BILLBOARDS], posY[MAX_BILLBOARDS];
+static float faceX[MAX_BILLBOARDS], faceY[MAX_BILLBOARDS];
+
+// Filled by the camera-space pass
+static float depth[MAX_BILLBOARDS];   // along the view direction
+static float lateral[MAX_BILLBOARDS]; // to the right of it
+// Where the camera is as seen from the billboard: along its facing, and
+// to one side of it
+static float viewAlong[MAX_BILLBOARDS], viewAcross[MAX_BILLBOARDS];
+
+void beginBillboards() {
+  billboardCount = 0;
+  stats.hidden = 0;
+}
+
+// How far the billboard reaches either side of its foot on the ground. Each
+// column it covers is drawn only where the column's ray is still short of
+// its wall (give or take the depth bias, and rays are up to
+// 1 / cos(FOV / 2) long), so it can only show if that ray crossed a cell in
+// this square around it.
+static float visibleRadius(const Billboard &b) {
+  float widest = 0.0f;
+  for (int v = 0; v < b.viewCount; v++)
+    widest = std::max(widest, (float)b.views[v].width / b.sizeViews[v].height);
+  static const float rayLength = 1.0f / cosf(FOV / 2.0f);
+  return 0.5f * b.height * widest + fabsf(b.depthBias) * rayLength +
+         VISIBLE_MARGIN;
+}
+
+bool addBillboard(const Billboard &billboard) {
+  // Anything no camera ray got near is behind a wall or outside the view
+  if (!areaVisible(billboard.x, billboard.y, visibleRadius(billboard))) {
+    stats.hidden++;
+    return true;
+  }
+  if (billboardCount == MAX_BILLBOARDS)
+    return false;
+
+  int i = billboardCount++;
+  billboards[i] = billboard;
+  posX[i] = billboard.x;
+  posY[i] = billboard.y;
+  faceX[i] = billboard.facingX;
+  faceY[i] = billboard.facingY;
+  return true;
+}
+
+// round(atan2(s, c) / 45 degrees) & 7, without the atan2: the direction
+// is turned half an octant so the octant edges land on the axes and
+// diagonals, then folded into the first quadrant a half turn and a
+// quarter turn at a time
+static int octant(float c, float s) {
+  const float cos22 = 0.92387953f; // cos(22.5 degrees)
+  const float sin22 = 0.38268343f;
+  float x = c * cos22 - s * sin22;
+  float y = c * sin22 + s * cos22;
+
+  int index = 0;
+  if (y < 0.0f) {
+    x = -x;
+    y = -y;
+    index = 4;
+  }
+  if (x < 0.0f) {
+    float t = x;
+    x = y;
+    y = -t;
+    index += 2;
+  }
+  if (y >= x)
+    index++;
+  return index & 7;
+}
+
+void drawBillboards(RenderContext *ctx) {
+  int w = ctx->width;
+  int h = ctx->height;
+  int count = billboardCount;
+
+  stats.added = count;
+  stats.culled = 0;
+  stats.drawn = 0;
+  beginEntityIds(ctx);
+
+  // Camera space for the whole list at once
+  float dirX = cosf(playerAngle);
+  float dirY = sinf(playerAngle);
+  float px = playerX;
+  float py = playerY;
+  for (int i = 0; i < count; i++) {
+    float dx = posX[i] - px;
+    float dy = posY[i] - py;
+    depth[i] = dx * dirX + dy * dirY;
+    lateral[i] = dy * dirX - dx * dirY;
+    viewAlong[i] = -(dx * faceX[i] + dy * faceY[i]);
+    viewAcross[i] = faceX[i] * dy - faceY[i] * dx;
+  }
+
+  // Far to near, so nearer sprites are drawn over further ones
+  int order[MAX_BILLBOARDS];
+  for (int i = 0; i < count; i++)
+    order[i] = i;
+  std::sort(order, order + count,
+            [](int a, int b) { return depth[a] > depth[b]; });
+
+  // Screen x = (0.5 + 0.5 * lateral / (depth * planeLength)) * w, the same
+  // projection render3DView casts its rays with
+  float halfWidthOverPlane = 0.5f * w / tanf(FOV / 2.0f);
+
+  for (int n = 0; n < count; n++) {
+    int i = order[n];
+    const Billboard &b = billboards[i];
+    if (depth[i] < NEAR_DEPTH) {
+      stats.culled++;
+      continue;
+    }
+
+    int view = 0;
+    bool mirror = false;
+    if (b.viewCount > 1) {
+      view = octant(viewAlong[i], viewAcross[i]);
+      mirror = b.mirror && b.mirror[view];
+    }
+    Sprite *sprite = &b.views[view];
+
+    float pixelsPerUnit = h / depth[i];
+    float scale = b.height / b.sizeViews[view].height * pixelsPerUnit;
+    int spriteW = int(sprite->width * scale);
+    int spriteH = int(sprite->height * scale);
+    int drawX = int(0.5f * w + lateral[i] / depth[i] * halfWidthOverPlane -
+                    spriteW / 2);
+    int drawY = h / 2 + int(b.bottom * pixelsPerUnit) - spriteH;
+    if (drawX >= w || drawX + spriteW <= 0 || drawY >= h ||
+        drawY + spriteH <= 0) {
+      stats.culled++;
+      continue;
+    }
+
+    if (ctx->zBuffer) {
+      drawSpriteScaledWithDepth(sprite, drawX, drawY, scale, mirror, ctx,
+                                depth[i] + b.depthBias);
+      if (b.id >= 0 && ctx->entityIds)
+        drawSpriteIds(sprite, drawX, drawY, scale, mirror, ctx,
+                      depth[i] + b.depthBias, b.id);
+    } else
+      drawSpriteScaled(sprite, drawX, drawY, scale, mirror, ctx);
+    stats.drawn++;
+  }
+}
+
+BillboardStats getBillboardStats() { return stats; }
@@ -0,0 +1,52 @@
+#pragma once
+#include "rendercontext.h"
+#include "sprite.h"
+
+// Per-frame draw list for everything drawn as a billboard: enemies, their
+// corpses and projectiles. After render3DView the entity modules add what
+// they want drawn, then drawBillboards moves the whole list into camera
+// space in one pass, sorts it far to near and draws it, so the nearer of
+// two overlapping sprites always ends up on top.
+#define MAX_BILLBOARDS 128
+
+struct Billboard {
+  float x, y;             // world position of its foot
+  float facingX, facingY; // direction it faces, any length
+  // The sprite seen from each of viewCount directions: 8, starting from
+  // the front and going round the way Doom numbers its rotations, or a
+  // single sprite that looks the same from everywhere. `mirror` (may be
+  // null) says which of the 8 are drawn flipped.
+  Sprite *views;
+  const bool *mirror;
+  int viewCount;
+  // Size: sizeViews[view] (usually `views`) is drawn `height` world units
+  // tall and the rest at the same scale, so every frame of an animation
+  // keeps its size
+  Sprite *sizeViews;
+  float height;
+  float bottom;    // world units from eye level down to its lowest row
+  float depthBias; // added to its distance for the zBuffer test
+  // Written to the context's entity IDs wherever it is drawn (0 to
+  // ENTITY_ID_MAX), or -1 to leave them alone, so things that don't stop
+  // shots (corpses, projectiles) never hide what is behind them
+  int id;
+};
+
+struct BillboardStats {
+  int hidden; // dropped by addBillboard: no camera ray crossed their cells
+  int added;  // billboards added this frame
+  int culled; // behind the camera or off the screen
+  int drawn;
+};
+
+// Starts a new frame's list
+void beginBillboards();
+// Drops billboards standing where the last render3DView's rays didn't
+// reach (see visible cells in raycast.h). False (and the billboard is
+// dropped) if the list is full.
+bool addBillboard(const Billboard &billboard);
+// Draws the list, far to near, depth-tested against ctx->zBuffer, and
+// starts a new frame of entity IDs if the context has them
+void drawBillboards(RenderContext *ctx);
+// Counts for the frame drawBillboards last drew
+BillboardStats getBillboardStats();
@@ -0,0 +1,21 @@
+#pragma once
+
+// Runtime CPU feature checks for the SIMD render paths. On anything that
+// isn't x86 they report false and the scalar paths are used.
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD 1
+// __builtin_cpu_init is cheap and makes these safe to call from static
+// initialisers, which may run before the compiler's own init
+inline bool cpuHasSSE41() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse4.1");
+}
+inline bool cpuHasAVX2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+#else
+#define HAVE_X86_SIMD 0
+inline bool cpuHasSSE41() { return false; }
+inline bool cpuHasAVX2() { return false; }
+#endif
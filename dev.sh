@@ -30,6 +30,11 @@ case "$1" in
         ./build/game
         ;;
     
+    bench)
+        echo -e "${BLUE}⏱️  Running render benchmark...${NC}"
+        cmake --build build && ./build/render_bench "${@:2}"
+        ;;
+    
     dev)
         # Quick rebuild and run
         cmake --build build && ./build/game
@@ -46,12 +51,13 @@ case "$1" in
         ;;
     
     *)
-        echo "Usage: ./dev.sh {clean|config|build|run|dev|fresh}"
+        echo "Usage: ./dev.sh {clean|config|build|run|bench|dev|fresh}"
         echo ""
         echo "  clean  - Remove build directory"
         echo "  config - Run CMake configuration"
         echo "  build  - Compile the project"
         echo "  run    - Run the game"
+        echo "  bench  - Build + run render_bench (extra args are passed on)"
         echo "  dev    - Quick build + run (use this most!)"
         echo "  fresh  - Clean + config + build + run"
         exit 1
@@ -1,7 +1,9 @@
 #include "enemy.h"
+#include "billboard.h"
 #include "map.h"
 #include "player.h"
 #include "projectile.h"
+#include "raycast.h"
 #include "sprite.h"
 #include <cmath>
 #include <cstdio>
@@ -113,35 +115,22 @@ void cleanupEnemySprites() {
     bool isBillboard = (f >= 14);
 
     if (isBillboard) {
-      if (allAngleSprites[f][0].pixels) {
-        delete[] allAngleSprites[f][0].pixels;
-        allAngleSprites[f][0].pixels = nullptr;
-      }
+      freeSprite(&allAngleSprites[f][0]);
     } else {
       for (int a = 0; a < 8; a++) {
-        if (allAngleSprites[f][a].pixels) {
-          delete[] allAngleSprites[f][a].pixels;
-          allAngleSprites[f][a].pixels = nullptr;
-        }
+        freeSprite(&allAngleSprites[f][a]);
       }
     }
   }
 }
 
+// One enemy per spawn point in the level, up to MAX_ENEMIES
 void initEnemies() {
-  // Strategic positions for testing AI
-  float spawnPositions[][2] = {
-      {3.5f, 2.5f},   // Top-left room
-      {16.5f, 2.5f},  // Top-right room
-      {10.0f, 9.5f},  // Big center area
-      {3.5f, 17.5f},  // Bottom-left room
-      {16.5f, 17.5f}, // Bottom-right room
-      {10.0f, 15.5f}  // Bottom center
-  };
+  enemyCount = level.spawnCount < MAX_ENEMIES ? level.spawnCount : MAX_ENEMIES;
   for (int i = 0; i < enemyCount; i++) {
     Enemy &e = enemies[i];
-    e.x = spawnPositions[i][0];
-    e.y = spawnPositions[i][1];
+    e.x = level.spawns[i].x;
+    e.y = level.spawns[i].y;
     e.vx = 0.0f;
     e.vy = 0.0f;
     e.prevX = e.x;
@@ -180,35 +169,29 @@ static bool hasLineOfSight(float x1, float y1, float x2, float y2) {
   if (dist < 0.1f)
     return true;
 
-  dx /= dist;
-  dy /= dist;
+  if (isSolid((int)y1, (int)x1))
+    return false;
 
-  float step = 0.1f;
-  for (float t = 0; t < dist; t += step) {
-    float x = x1 + dx * t;
-    float y = y1 + dy * t;
-    if (getMapTile((int)y, (int)x) == 1) {
-      return false;
-    }
-  }
-  return true;
+  // Clear if the first wall along the line is no nearer than the target
+  RayHit hit = castRayFrom(x1, y1, dx / dist, dy / dist);
+  return hit.distance >= dist;
 }
 
 // SIMPLIFIED: Check if a position would collide with walls
 static bool isPositionValid(float x, float y) {
   // Check center
-  if (getMapTile((int)y, (int)x) == 1) {
+  if (isSolid((int)y, (int)x)) {
     return false;
   }
 
   // Check 4 cardinal directions for the buffer zone
-  if (getMapTile((int)y, (int)(x + ENEMY_WALL_BUFFER)) == 1)
+  if (isSolid((int)y, (int)(x + ENEMY_WALL_BUFFER)))
     return false;
-  if (getMapTile((int)y, (int)(x - ENEMY_WALL_BUFFER)) == 1)
+  if (isSolid((int)y, (int)(x - ENEMY_WALL_BUFFER)))
     return false;
-  if (getMapTile((int)(y + ENEMY_WALL_BUFFER), (int)x) == 1)
+  if (isSolid((int)(y + ENEMY_WALL_BUFFER), (int)x))
     return false;
-  if (getMapTile((int)(y - ENEMY_WALL_BUFFER), (int)x) == 1)
+  if (isSolid((int)(y - ENEMY_WALL_BUFFER), (int)x))
     return false;
 
   return true;
@@ -252,22 +235,30 @@ void damageEnemy(int enemyIndex, int damage) {
   }
 }
 
-int hitscanCheckEnemy() {
-  const float MAX_RANGE = 20.0f;
+// Hitscan shots reach this far
+static const float HITSCAN_RANGE = 20.0f;
+
+// Dying enemies and corpses don't stop shots
+static bool canBeShot(const Enemy &e) {
+  return e.alive && e.animState != ANIM_DEATH && e.animState != ANIM_XDEATH;
+}
 
-  float rayDX = cosf(playerAngle);
-  float rayDY = sinf(playerAngle);
+int hitscanCheckEnemy(float angle) {
+  float rayDX = cosf(angle);
+  float rayDY = sinf(angle);
 
+  int nearest = -1;
+  float nearestDist = HITSCAN_RANGE;
   for (int i = 0; i < enemyCount; i++) {
     Enemy &e = enemies[i];
-    if (!e.alive || e.animState == ANIM_DEATH)
+    if (!canBeShot(e))
       continue;
 
     float toEnemyX = e.x - playerX;
     float toEnemyY = e.y - playerY;
     float dist = sqrtf(toEnemyX * toEnemyX + toEnemyY * toEnemyY);
 
-    if (dist > MAX_RANGE)
+    if (dist > nearestDist)
       continue;
 
     float dotProduct = toEnemyX * rayDX + toEnemyY * rayDY;
@@ -281,13 +272,23 @@ int hitscanCheckEnemy() {
     float dy = e.y - closestY;
     float distToRay = sqrtf(dx * dx + dy * dy);
 
-    if (distToRay < ENEMY_RADIUS) {
-      if (hasLineOfSight(playerX, playerY, e.x, e.y)) {
-        return i;
-      }
+    if (distToRay < ENEMY_RADIUS &&
+        hasLineOfSight(playerX, playerY, e.x, e.y)) {
+      nearest = i;
+      nearestDist = dist;
     }
   }
-  return -1;
+  return nearest;
+}
+
+int pickEnemy(const RenderContext *view, int x, int y) {
+  int i = entityIdAt(view, x, y);
+  if (i < 0 || i >= enemyCount || !canBeShot(enemies[i]))
+    return -1;
+
+  float dx = enemies[i].x - playerX;
+  float dy = enemies[i].y - playerY;
+  return dx * dx + dy * dy <= HITSCAN_RANGE * HITSCAN_RANGE ? i : -1;
 }
 
 void updateEnemies(float dt) {
@@ -581,74 +582,29 @@ void updateEnemies(float dt) {
     }
   }
 }
-void renderEnemies(uint32_t *pixels, int screenWidth, int screenHeight,
-                   float *buffer) {
-  int w = screenWidth;
-  int h = screenHeight;
-  float *zBuffer = buffer;
-  const float FOV = M_PI / 3.0f;
-
+void addEnemyBillboards() {
   for (int i = 0; i < enemyCount; i++) {
     Enemy &e = enemies[i];
-    float dx = e.x - playerX;
-    float dy = e.y - playerY;
-    float dist = sqrtf(dx * dx + dy * dy);
-    if (dist < 0.1f)
-      continue;
-
-    float angleToEnemy = atan2f(dy, dx);
-    float relAngle = angleToEnemy - playerAngle;
-    while (relAngle < -M_PI)
-      relAngle += 2 * M_PI;
-    while (relAngle > M_PI)
-      relAngle -= 2 * M_PI;
-    if (fabs(relAngle) > FOV * 0.5f)
-      continue;
-
-    float spriteAngle = e.facingAngle - angleToEnemy + M_PI;
-    while (spriteAngle < 0)
-      spriteAngle += 2 * M_PI;
-    while (spriteAngle >= 2 * M_PI)
-      spriteAngle -= 2 * M_PI;
-
-    int angleIndex = int(((spriteAngle / (2 * M_PI)) * 8) + 0.5) & 7;
 
+    Billboard b;
+    b.x = e.x;
+    b.y = e.y;
+    b.facingX = cosf(e.facingAngle);
+    b.facingY = sinf(e.facingAngle);
+    b.views = allAngleSprites[e.frameIndex];
+    b.viewCount = 8;
     // Billboard sprites (death frames) should never be mirrored
-    bool mirror = (e.frameIndex < 14) ? shouldMirror[angleIndex] : false;
-
-    Sprite &sprite = allAngleSprites[e.frameIndex][angleIndex];
-
-    float corrected = dist * cosf(relAngle);
-    if (corrected < 0.1f)
-      corrected = 0.1f;
-
-    int wallHeight = int((float(h) / corrected) * 0.8f);
-    int floorLine = (h / 2) + wallHeight;
-    int targetHeight = int((float(h) / corrected) * 1.1f);
-
+    b.mirror = e.frameIndex < 14 ? shouldMirror : nullptr;
     // Death frames: use FIRST death frame's height as reference
-    Sprite &refSprite = allAngleSprites[0][angleIndex];
-    float scale = float(targetHeight) / refSprite.height;
-
-    // Sprite dimensions at this scale
-    int spriteW = int(sprite.width * scale);
-    int spriteH = int(sprite.height * scale);
-    int drawX = int((0.5f + relAngle / FOV) * w - spriteW / 2);
-    int drawY = floorLine - spriteH;
-
-    if (zBuffer) {
-      float renderDepth = corrected;
-      // Make death sprites slightly closer so they render over floor
-      if (e.frameIndex >= 14) {
-        renderDepth -= 0.2f; // Bring corpses 0.1 units closer
-      }
-
-      drawSpriteScaledWithDepth(&sprite, drawX, drawY, scale, mirror, pixels, w,
-                                h, zBuffer, renderDepth);
-    } else {
-      drawSpriteScaled(&sprite, drawX, drawY, scale, mirror, pixels, w, h);
-    }
+    b.sizeViews = allAngleSprites[0];
+    b.height = 1.1f;
+    b.bottom = 0.8f;
+    // Make death sprites slightly closer so they render over floor
+    b.depthBias = e.frameIndex >= 14 ? -0.2f : 0.0f;
+    b.id = canBeShot(e) ? i : -1;
+    addBillboard(b);
   }
 }
+
 int getEnemyCount() { return enemyCount; }
 Enemy &getEnemy(int i) { return enemies[i]; }
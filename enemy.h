@@ -48,9 +48,15 @@ bool loadEnemySprites();
 void cleanupEnemySprites();
 void initEnemies();
 void updateEnemies(float deltaTime);
-void renderEnemies(uint32_t *pixels, int screenWidth, int screenHeight,
-                   float *buffer);
+// Adds this frame's enemies and corpses to the billboard list
+void addEnemyBillboards();
 int getEnemyCount();
 Enemy &getEnemy(int index);
 void damageEnemy(int enemyIndex, int damage);
-int hitscanCheckEnemy();
+// Nearest enemy a shot fired from the player at `angle` hits, or -1,
+// testing the shot against every enemy
+int hitscanCheckEnemy(float angle);
+// Enemy drawn at pixel (x, y) of the frame last drawn into `view`, read
+// from its entity IDs, or -1. The drawing has already settled which enemy
+// is nearest there and whether a wall is in the way.
+int pickEnemy(const RenderContext *view, int x, int y);
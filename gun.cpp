@@ -72,18 +72,13 @@ bool loadGunSprites() {
 }
 
 void cleanupGunSprites() {
-  if (gunIdle.pixels)
-    delete[] gunIdle.pixels;
+  freeSprite(&gunIdle);
 
-  for (int i = 0; i < 3; i++) {
-    if (gunFire[i].pixels)
-      delete[] gunFire[i].pixels;
-  }
+  for (int i = 0; i < 3; i++)
+    freeSprite(&gunFire[i]);
 
-  for (int i = 0; i < 9; i++) {
-    if (gunReload[i].pixels)
-      delete[] gunReload[i].pixels;
-  }
+  for (int i = 0; i < 9; i++)
+    freeSprite(&gunReload[i]);
 }
 
 void updateGun(float deltaTime) {
@@ -126,8 +121,9 @@ void updateGun(float deltaTime) {
   }
 }
 
-void drawGun(uint32_t *pixels, int WIDTH, int HEIGHT) {
-  float scale = 1.2f;
+void drawGun(RenderContext *ctx) {
+  // Sized for a 400 pixel tall view and scaled with it
+  float scale = 1.2f * ctx->height / 400.0f;
 
   // Choose which sprite to draw
   Sprite *currentSprite = &gunIdle;
@@ -144,11 +140,10 @@ void drawGun(uint32_t *pixels, int WIDTH, int HEIGHT) {
   int scaledHeight = (int)(currentSprite->height * scale);
 
   // Center horizontally, place at bottom of screen
-  int gunX = WIDTH / 2 - scaledWidth / 2;
-  int gunY = HEIGHT - scaledHeight - 5;
+  int gunX = ctx->width / 2 - scaledWidth / 2;
+  int gunY = ctx->height - scaledHeight - 5;
 
-  drawSpriteScaled(currentSprite, gunX, gunY, scale, false, pixels, WIDTH,
-                   HEIGHT);
+  drawSpriteScaled(currentSprite, gunX, gunY, scale, false, ctx);
 }
 
 void startReload() {
@@ -160,11 +155,13 @@ void startReload() {
   }
 }
 
-void startShoot() {
-  if (!isReloading && !isShooting) {
-    isShooting = true;
-    shootTimer = 0.0f;
-    currentShootFrame = 0;
-    printf("BOOM! Shotgun blast!\n");
-  }
+bool startShoot() {
+  if (isReloading || isShooting)
+    return false;
+
+  isShooting = true;
+  shootTimer = 0.0f;
+  currentShootFrame = 0;
+  printf("BOOM! Shotgun blast!\n");
+  return true;
 }
@@ -1,4 +1,5 @@
 #pragma once
+#include "rendercontext.h"
 #include <cstdint>
 
 // Loading / cleanup
@@ -7,8 +8,14 @@ void cleanupGunSprites();
 
 // Update & draw
 void updateGun(float deltaTime);
-void drawGun(uint32_t *pixels, int WIDTH, int HEIGHT);
+void drawGun(RenderContext *ctx);
+
+// Each blast fires SHOTGUN_PELLETS pellets, spread at random up to
+// SHOTGUN_SPREAD radians either side of the crosshair
+#define SHOTGUN_PELLETS 7
+#define SHOTGUN_SPREAD 0.1f
+#define SHOTGUN_PELLET_DAMAGE 24
 
 // Actions
 void startReload();
-void startShoot();
+bool startShoot(); // false while reloading or still firing
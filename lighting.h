@@ -0,0 +1,43 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// Doom-style light levels. Instead of scaling every channel by a float shade
+// factor, the renderer picks one of LIGHT_LEVELS levels per wall column or
+// per floor/ceiling row and maps each 8-bit channel through that level's
+// 256-entry table.
+#define LIGHT_LEVELS 32
+
+// Brightness of a light level in 1/256ths (level 0 is black, the top level
+// leaves the colour unchanged)
+constexpr int lightScale(int level) {
+  return (level * 256 + (LIGHT_LEVELS - 1) / 2) / (LIGHT_LEVELS - 1);
+}
+
+typedef std::array<std::array<uint8_t, 256>, LIGHT_LEVELS> LightTable;
+
+constexpr LightTable buildLightTable() {
+  LightTable table{};
+  for (int level = 0; level < LIGHT_LEVELS; level++)
+    for (int c = 0; c < 256; c++)
+      table[level][c] = (uint8_t)((c * lightScale(level)) >> 8);
+  return table;
+}
+
+inline constexpr LightTable lightTable = buildLightTable();
+
+// Nearest light level for a 0..1 shade factor
+inline int lightLevel(float shade) {
+  int level = (int)(shade * (LIGHT_LEVELS - 1) + 0.5f);
+  if (level < 0)
+    return 0;
+  if (level >= LIGHT_LEVELS)
+    return LIGHT_LEVELS - 1;
+  return level;
+}
+
+// Shades an ARGB pixel with one row of lightTable, forcing it opaque
+inline uint32_t applyLight(uint32_t color, const uint8_t *light) {
+  return 0xFF000000u | ((uint32_t)light[(color >> 16) & 0xFF] << 16) |
+         ((uint32_t)light[(color >> 8) & 0xFF] << 8) | light[color & 0xFF];
+}
@@ -1,29 +1,287 @@
+#include "billboard.h"
 #include "enemy.h"
 #include "gun.h"
 #include "map.h"
 #include "player.h"
 #include "projectile.h" // ADD THIS
+#include "pipeline.h"
 #include "renderer.h"
+#include "resolution.h"
+#include "threadpool.h"
+#include "wallslice.h"
 #include <SDL2/SDL.h>
+#include <chrono>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
 
-const int WIDTH = 620;
-const int HEIGHT = 400;
-uint32_t pixels[WIDTH * HEIGHT];
+const int WINDOW_WIDTH = 1240;
+const int WINDOW_HEIGHT = 800;
+
+// Render resolutions cycled with F5; the window keeps its size and the
+// frame is stretched to fit
+const int RESOLUTIONS[][2] = {
+    {620, 400}, {1280, 720}, {1920, 1080}, {2560, 1440}, {3840, 2160}};
+const int RESOLUTION_COUNT = sizeof(RESOLUTIONS) / sizeof(RESOLUTIONS[0]);
+
+// One output frame in the pipeline: a render context drawing straight into
+// a streaming texture while the frame thread owns it
+struct FrameBuffer {
+  RenderContext ctx;
+  SDL_Texture *texture;
+  bool locked; // texture is locked and ctx draws into it
+};
+
+FrameBuffer frameBuffers[MAX_PIPELINE_BUFFERS];
+int frameBufferCount = 2;
+RenderContext scene; // 3D view when dynamic resolution scales it down
+
+// Key events are read on the main thread and applied on the frame thread
+struct KeyEvent {
+  SDL_Keycode key;
+  bool down;
+};
+std::mutex inputMutex;
+std::vector<KeyEvent> pendingInput;
+
+// Frame thread state
+bool dynamicResolution = true;
+ResolutionController resolution;
+Uint32 lastTime = 0;
 float fpsTimer = 0.0f;
 int fpsFrames = 0;
 int currentFPS = 0;
 
-int main() {
+static void applyInput() {
+  std::vector<KeyEvent> events;
+  {
+    std::lock_guard<std::mutex> lock(inputMutex);
+    events.swap(pendingInput);
+  }
+
+  for (const KeyEvent &e : events) {
+    handlePlayerInput(e.key, e.down);
+    if (!e.down)
+      continue;
+
+    // L flips between the light tables and the old float shading
+    if (e.key == SDLK_l) {
+      bool tables = getShadingMode() == SHADING_FLOAT;
+      setShadingMode(tables ? SHADING_COLORMAP : SHADING_FLOAT);
+      printf("Shading: %s\n", tables ? "light tables" : "float");
+    }
+
+    // F6 toggles dynamic resolution
+    if (e.key == SDLK_F6) {
+      dynamicResolution = !dynamicResolution;
+      printf("Dynamic resolution: %s\n", dynamicResolution ? "on" : "off");
+    }
+  }
+}
+
+// Frame thread: simulates one step and draws it into frame buffer `buffer`
+static void runFrame(void *userData, int buffer) {
+  (void)userData;
+  RenderContext *out = &frameBuffers[buffer].ctx;
+
+  auto frameStart = std::chrono::steady_clock::now();
+  Uint32 currentTime = SDL_GetTicks();
+  float deltaTime = (currentTime - lastTime) / 1000.0f;
+  lastTime = currentTime;
+
+  if (deltaTime > 0.05f)
+    deltaTime = 0.05f;
+
+  fpsTimer += deltaTime;
+  fpsFrames++;
+  if (fpsTimer >= 1.0f) {
+    currentFPS = fpsFrames;
+    printf("FPS: %d\n", currentFPS);
+    fpsFrames = 0;
+    fpsTimer = 0.0f;
+  }
+
+  applyInput();
+
+  // Nothing is reading the map between frames, so chunks can come and go
+  updateMapStreaming(playerX, playerY);
+  updatePlayer(deltaTime);
+  updateGun(deltaTime);
+  updateEnemies(deltaTime);
+  updateProjectiles(deltaTime); // ADD THIS
+
+  // Check if player got hit  // ADD THIS
+  if (checkProjectilePlayerHit(playerX, playerY, 0.3f)) {
+    printf("Player hit by projectile!\n");
+    // TODO: Reduce player health here
+  }
+
+  // The world is drawn at the scaled resolution and stretched to the
+  // output; the HUD is drawn over it at full resolution
+  int sceneWidth = out->width;
+  int sceneHeight = out->height;
+  if (dynamicResolution)
+    scaledResolution(&resolution, out->width, out->height, &sceneWidth,
+                     &sceneHeight);
+  RenderContext *view = out;
+  if (sceneWidth != out->width || sceneHeight != out->height) {
+    if (resizeRenderContext(&scene, sceneWidth, sceneHeight))
+      view = &scene;
+  }
+
+  // render3DView writes every pixel, so nothing needs clearing first
+  render3DView(view);
+  beginBillboards();
+  addEnemyBillboards();
+  addProjectileBillboards();
+  drawBillboards(view);
+  fireShot(view);
+  if (view != out)
+    upscaleNearest(view, out);
+
+  drawGun(out);
+  renderMinimap(out);
+
+  // Only the frame thread's own work counts against the budget
+  float frameMs = std::chrono::duration<float, std::milli>(
+                      std::chrono::steady_clock::now() - frameStart)
+                      .count();
+  if (dynamicResolution && updateResolutionController(&resolution, frameMs)) {
+    printf("Render scale: %d%% (%.2f ms/frame)\n",
+           (int)(resolution.scale * 100.0f + 0.5f), resolution.averageMs);
+  }
+}
+
+// Locks the buffer's texture so the frame is drawn straight into it, then
+// hands the buffer to the frame thread. If the texture can't be locked the
+// frame goes into the context's own buffer and is uploaded when presented.
+static void handOutFrameBuffer(int buffer) {
+  FrameBuffer &fb = frameBuffers[buffer];
+  void *texPixels = nullptr;
+  int texPitch = 0;
+  fb.locked = SDL_LockTexture(fb.texture, nullptr, &texPixels, &texPitch) == 0;
+  setRenderTarget(&fb.ctx, fb.locked ? (uint32_t *)texPixels : nullptr,
+                  texPitch / (int)sizeof(uint32_t));
+  queueFrameBuffer(buffer);
+}
+
+static void releaseTexture(FrameBuffer &fb) {
+  if (fb.locked)
+    SDL_UnlockTexture(fb.texture);
+  fb.locked = false;
+}
+
+static void presentFrame(SDL_Renderer *ren, int buffer) {
+  FrameBuffer &fb = frameBuffers[buffer];
+  if (fb.locked)
+    releaseTexture(fb);
+  else
+    SDL_UpdateTexture(fb.texture, nullptr, fb.ctx.pixels,
+                      fb.ctx.pitch * sizeof(uint32_t));
+  SDL_RenderCopy(ren, fb.texture, nullptr, nullptr);
+  SDL_RenderPresent(ren);
+}
+
+// (Re)creates every frame buffer at the output resolution. Only call while
+// the pipeline is stopped, when the main thread owns all of them.
+static bool createFrameBuffers(SDL_Renderer *ren, int width, int height,
+                               bool hugePages) {
+  for (int i = 0; i < frameBufferCount; i++) {
+    FrameBuffer &fb = frameBuffers[i];
+    if (fb.texture) {
+      releaseTexture(fb);
+      SDL_DestroyTexture(fb.texture);
+    }
+    fb.texture = SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888,
+                                   SDL_TEXTUREACCESS_STREAMING, width, height);
+
+    bool ok = fb.ctx.memory ? resizeRenderContext(&fb.ctx, width, height)
+                            : createRenderContext(&fb.ctx, width, height,
+                                                  hugePages);
+    // Shots are picked from the entity IDs of whichever context the
+    // billboards were drawn into
+    if (!ok || !setEntityIdBuffer(&fb.ctx, true))
+      return false;
+  }
+  return true;
+}
+
+static void startPipeline(bool boundLatency) {
+  startFramePipeline(boundLatency, runFrame, nullptr);
+  for (int i = 0; i < frameBufferCount; i++)
+    handOutFrameBuffer(i);
+}
+
+static void stopPipeline() {
+  stopFramePipeline();
+  for (int i = 0; i < frameBufferCount; i++)
+    releaseTexture(frameBuffers[i]);
+}
+
+int main(int argc, char *argv[]) {
+  // Render threads: --threads N, defaults to one per hardware thread
+  // --res WxH picks the starting resolution, --hugepages backs the render
+  // buffers with 2 MB pages where the OS allows it, --budget MS sets the
+  // frame time dynamic resolution aims for (0 turns it off), --buffers 3
+  // lets the frame thread run two frames ahead instead of one,
+  // --bound-latency never queues more than one finished frame and
+  // --map FILE plays a map built by mapconv instead of the built-in level
+  int renderThreads = (int)std::thread::hardware_concurrency();
+  int width = RESOLUTIONS[0][0];
+  int height = RESOLUTIONS[0][1];
+  bool hugePages = false;
+  bool boundLatency = false;
+  float budgetMs = 8.0f;
+  const char *mapPath = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+      renderThreads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--res") && i + 1 < argc)
+      sscanf(argv[++i], "%dx%d", &width, &height);
+    else if (!strcmp(argv[i], "--hugepages"))
+      hugePages = true;
+    else if (!strcmp(argv[i], "--budget") && i + 1 < argc)
+      budgetMs = (float)atof(argv[++i]);
+    else if (!strcmp(argv[i], "--buffers") && i + 1 < argc)
+      frameBufferCount = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--bound-latency"))
+      boundLatency = true;
+    else if (!strcmp(argv[i], "--map") && i + 1 < argc)
+      mapPath = argv[++i];
+  }
+  if (mapPath && !loadMap(mapPath))
+    return 1;
+  playerX = level.startX;
+  playerY = level.startY;
+  playerAngle = level.startAngle;
+  if (frameBufferCount < 2)
+    frameBufferCount = 2;
+  if (frameBufferCount > MAX_PIPELINE_BUFFERS)
+    frameBufferCount = MAX_PIPELINE_BUFFERS;
+  if (!createRenderContext(&scene, width, height, hugePages) ||
+      !setEntityIdBuffer(&scene, true))
+    return 1;
+
+  dynamicResolution = budgetMs > 0.0f;
+  initResolutionController(&resolution, dynamicResolution ? budgetMs : 8.0f);
+  int resolutionIndex = -1; // --res sizes aren't necessarily in the list
+
+  startThreadPool(renderThreads);
+  printf("Rendering with %d threads, %s wall kernel, %s sprite kernel, "
+         "%d frame buffers\n",
+         getThreadPoolSize(), wallKernelName(getWallKernel()),
+         spriteKernelName(getSpriteKernel()), frameBufferCount);
+
   SDL_Init(SDL_INIT_VIDEO);
-  SDL_Window *win =
-      SDL_CreateWindow("Doom with Gun", SDL_WINDOWPOS_CENTERED,
-                       SDL_WINDOWPOS_CENTERED, WIDTH * 2, HEIGHT * 2, 0);
+  SDL_Window *win = SDL_CreateWindow("Doom with Gun", SDL_WINDOWPOS_CENTERED,
+                                     SDL_WINDOWPOS_CENTERED, WINDOW_WIDTH,
+                                     WINDOW_HEIGHT, 0);
   SDL_Renderer *ren = SDL_CreateRenderer(win, -1, 0);
-  SDL_Texture *tex =
-      SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888,
-                        SDL_TEXTUREACCESS_STREAMING, WIDTH, HEIGHT);
+  if (!createFrameBuffers(ren, width, height, hugePages))
+    return 1;
 
   if (!loadGunSprites()) {
     printf("ERROR: Could not load gun sprites!\n");
@@ -38,6 +296,10 @@ int main() {
     printf("Error: Could not load a ceiuling sprite");
   }
 
+  if (!loadFloorTexture("sprites/Ceiling.png")) {
+    printf("WARNING: Could not load floor texture! Using solid color.\n");
+  }
+
   if (!loadEnemySprites()) {
     printf("Error: Could not load enemies\n");
     return 1;
@@ -51,71 +313,70 @@ int main() {
   initEnemies();
   initProjectiles(); // ADD THIS
 
+  // The frame thread simulates and renders frame N+1 while this thread
+  // presents frame N, so vsync waits no longer stall rendering
   bool running = true;
-  Uint32 lastTime = SDL_GetTicks();
+  lastTime = SDL_GetTicks();
+  startPipeline(boundLatency);
 
   while (running) {
-    Uint32 currentTime = SDL_GetTicks();
-    float deltaTime = (currentTime - lastTime) / 1000.0f;
-    lastTime = currentTime;
-
-    if (deltaTime > 0.05f)
-      deltaTime = 0.05f;
-
-    fpsTimer += deltaTime;
-    fpsFrames++;
-    if (fpsTimer >= 1.0f) {
-      currentFPS = fpsFrames;
-      printf("FPS: %d\n", currentFPS);
-      fpsFrames = 0;
-      fpsTimer = 0.0f;
-    }
-
     SDL_Event e;
     while (SDL_PollEvent(&e)) {
       if (e.type == SDL_QUIT)
         running = false;
 
-      if (e.type == SDL_KEYDOWN) {
-        handlePlayerInput(e.key.keysym.sym, true);
+      if (e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        pendingInput.push_back({e.key.keysym.sym, e.type == SDL_KEYDOWN});
       }
 
-      if (e.type == SDL_KEYUP) {
-        handlePlayerInput(e.key.keysym.sym, false);
+      // F5 steps through the render resolutions. The textures belong to
+      // this thread, so the pipeline is drained while they are replaced.
+      // If the new size can't be allocated we fall back to the old one,
+      // and only shut down if even that fails.
+      if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F5) {
+        int previousIndex = resolutionIndex;
+        resolutionIndex = (resolutionIndex + 1) % RESOLUTION_COUNT;
+        int w = RESOLUTIONS[resolutionIndex][0];
+        int h = RESOLUTIONS[resolutionIndex][1];
+        stopPipeline();
+        if (createFrameBuffers(ren, w, h, hugePages)) {
+          width = w;
+          height = h;
+          printf("Resolution: %dx%d\n", w, h);
+        } else {
+          printf("WARNING: Could not switch to %dx%d, staying at %dx%d\n", w,
+                 h, width, height);
+          resolutionIndex = previousIndex;
+          if (!createFrameBuffers(ren, width, height, hugePages)) {
+            printf("ERROR: Could not recreate the frame buffers!\n");
+            running = false;
+            break;
+          }
+        }
+        startPipeline(boundLatency);
       }
     }
 
-    updatePlayer(deltaTime);
-    updateGun(deltaTime);
-    updateEnemies(deltaTime);
-    updateProjectiles(deltaTime); // ADD THIS
-
-    // Check if player got hit  // ADD THIS
-    if (checkProjectilePlayerHit(playerX, playerY, 0.3f)) {
-      printf("Player hit by projectile!\n");
-      // TODO: Reduce player health here
-    }
-
-    memset(pixels, 0, sizeof(pixels));
-    render3DView(pixels, WIDTH, HEIGHT);
-    renderEnemies(pixels, WIDTH, HEIGHT, getZBuffer());
-    renderProjectiles(pixels, WIDTH, HEIGHT,
-                      getZBuffer()); // ADD THIS (before enemies)
-
-    drawGun(pixels, WIDTH, HEIGHT);
-    renderMinimap(pixels, WIDTH, HEIGHT);
-
-    SDL_UpdateTexture(tex, nullptr, pixels, WIDTH * sizeof(uint32_t));
-    SDL_RenderCopy(ren, tex, nullptr, nullptr);
-    SDL_RenderPresent(ren);
-
-    SDL_Delay(1);
+    // Short timeout so input is still read if a frame takes a while
+    int buffer = takeFinishedFrame(10);
+    if (buffer < 0)
+      continue;
+    presentFrame(ren, buffer);
+    handOutFrameBuffer(buffer);
   }
 
+  stopPipeline();
   cleanupGunSprites();
   cleanupWallTexture();
   cleanupEnemySprites();
   cleanupProjectileSprites(); // ADD THIS
+  stopThreadPool();
+  for (int i = 0; i < frameBufferCount; i++) {
+    SDL_DestroyTexture(frameBuffers[i].texture);
+    destroyRenderContext(&frameBuffers[i].ctx);
+  }
+  destroyRenderContext(&scene);
 
   SDL_Quit();
   return 0;
@@ -1,52 +1,14 @@
 #include "map.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-// int map[MAP_SIZE][MAP_SIZE] = {
-//     // Row 0 - North boundary
-//     {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
-//
-//     // Rows 1-5 - North wing with secret room
-//     {1, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 1},
-//     {1, 0, 1, 0, 1, 0, 1, 1, 0, 1, 0, 1, 1, 0, 1, 0, 0, 0, 0, 1, 1, 1, 0, 1},
-//     {1, 0, 1, 0, 0, 0, 1, 1, 0, 0, 0, 1, 1, 0, 0, 0, 1, 1, 0, 1, 0, 0, 0, 1},
-//     {1, 0, 1, 1, 1, 0, 1, 1, 0, 1, 0, 1, 1, 0, 1, 0, 0, 0, 0, 1, 0, 1, 0, 1},
-//     {1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 1, 0, 1, 1, 1, 0, 1, 0, 1},
-//
-//     // Rows 6-7 - Upper corridor
-//     {1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 0, 1, 1, 0, 0, 0, 0, 0, 0, 1, 0, 1},
-//     {1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 0, 1, 0, 1},
-//
-//     // Rows 8-11 - Main hall (large combat arena)
-//     {1, 0, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 0, 1, 1, 0, 0, 0, 0, 1, 0, 0, 0, 1},
-//     {1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 1},
-//     {1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-//     {1, 0, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 0, 1, 1, 0, 0, 0, 0, 1, 1, 0, 1, 1},
-//
-//     // Rows 12-13 - Central corridor
-//     {1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 0, 0, 0, 1},
-//     {1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 0, 0, 0, 0, 1, 0, 1},
-//
-//     // Rows 14-17 - West courtyard and east storage
-//     {1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 0, 1},
-//     {1, 0, 1, 1, 0, 1, 1, 1, 0, 1, 0, 1, 1, 1, 1, 0, 1, 0, 0, 0, 0, 1, 0, 1},
-//     {1, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 1, 1, 1, 1, 0, 1, 0, 1},
-//     {1, 0, 0, 0, 0, 1, 1, 1, 0, 1, 0, 1, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-//
-//     // Rows 18-19 - Lower corridor
-//     {1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 0, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1},
-//     {1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-//
-//     // Rows 20-22 - Starting room (south)
-//     {1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 0, 1, 1, 1, 1, 0, 1},
-//     {1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-//      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1}, // S - Player start (1.5, 21.5)
-//     {1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1},
-//
-//     // Row 23 - South boundary
-//     {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
-//     1}};
-//
-
-int map[MAP_SIZE][MAP_SIZE] = {
+// Built-in level, used when no map file is given
+static uint8_t builtinTiles[20][20] = {
     {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
     {1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1},
     {1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1},
@@ -68,8 +30,238 @@ int map[MAP_SIZE][MAP_SIZE] = {
     {1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1},
     {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}};
 
+// Strategic positions for testing AI
+static const MapSpawn builtinSpawns[] = {
+    {3.5f, 2.5f},   // Top-left room
+    {16.5f, 2.5f},  // Top-right room
+    {10.0f, 9.5f},  // Big center area
+    {3.5f, 17.5f},  // Bottom-left room
+    {16.5f, 17.5f}, // Bottom-right room
+    {10.0f, 15.5f}  // Bottom center
+};
+
+static constexpr Level builtinLevel = {
+    20,   20,   &builtinTiles[0][0], builtinSpawns, 6,
+    2.5f, 2.5f, (float)M_PI / 4.0f}; // Facing diagonal
+
+Level level = builtinLevel;
+
+// The current map file mapping, if any
+static void *mappedFile = nullptr;
+static size_t mappedSize = 0;
+
+// Spawn points of a streamed map, which has no mapping to point into
+static std::vector<MapSpawn> streamedSpawns;
+
+// Checks that everything the header points at lies inside the file
+static bool validMapHeader(const MapFileHeader *h, size_t fileSize) {
+  if (h->magic != MAP_FILE_MAGIC || h->version != MAP_FILE_VERSION)
+    return false;
+  if (h->width < 1 || h->height < 1 || h->width > MAP_MAX_SIZE ||
+      h->height > MAP_MAX_SIZE)
+    return false;
+  if (h->tileTypes > MAP_TILE_TYPES || h->spawnCount > MAP_MAX_SIZE)
+    return false;
+
+  uint64_t tilesEnd =
+      (uint64_t)h->tilesOffset + (uint64_t)h->width * h->height;
+  uint64_t spawnsEnd =
+      (uint64_t)h->spawnsOffset + (uint64_t)h->spawnCount * sizeof(MapSpawn);
+  return h->tilesOffset >= sizeof(MapFileHeader) && tilesEnd <= fileSize &&
+         h->spawnsOffset % alignof(MapSpawn) == 0 && spawnsEnd <= fileSize;
+}
+
+static void releaseMap() {
+  if (mappedFile)
+    munmap(mappedFile, mappedSize);
+  mappedFile = nullptr;
+  mappedSize = 0;
+  closeStreamedMap();
+}
+
+static void setLevel(const MapFileHeader &h, uint8_t *tiles,
+                     const MapSpawn *spawns) {
+  level.width = h.width;
+  level.height = h.height;
+  level.tiles = tiles;
+  level.spawns = spawns;
+  level.spawnCount = h.spawnCount;
+  level.startX = h.startX;
+  level.startY = h.startY;
+  level.startAngle = h.startAngle;
+}
+
+// Too big to keep whole: only the spawn points are read now, the tiles a
+// chunk at a time as the player gets near them
+static bool streamMap(const char *path, int fd, const MapFileHeader &h) {
+  std::vector<MapSpawn> spawns(h.spawnCount);
+  ssize_t spawnBytes = spawns.size() * sizeof(MapSpawn);
+  if (pread(fd, spawns.data(), spawnBytes, h.spawnsOffset) != spawnBytes) {
+    printf("ERROR: Could not read %s\n", path);
+    close(fd);
+    return false;
+  }
+
+  releaseMap();
+  streamedSpawns.swap(spawns);
+  setLevel(h, nullptr, streamedSpawns.data());
+  openStreamedMap(fd, h, h.startX, h.startY);
+
+  printf("Loaded map %s: %dx%d, %d spawn points\n", path, level.width,
+         level.height, level.spawnCount);
+  return true;
+}
+
+bool loadMap(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    printf("ERROR: Could not open map %s\n", path);
+    return false;
+  }
+
+  struct stat st;
+  MapFileHeader h;
+  if (fstat(fd, &st) != 0 ||
+      pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) ||
+      !validMapHeader(&h, st.st_size)) {
+    printf("ERROR: %s is not a valid map file\n", path);
+    close(fd);
+    return false;
+  }
+
+  if (h.width > MAP_STREAM_SIZE || h.height > MAP_STREAM_SIZE)
+    return streamMap(path, fd, h);
+
+  void *p = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                 fd, 0);
+  close(fd); // the mapping keeps the file open
+  if (p == MAP_FAILED) {
+    printf("ERROR: Could not map %s\n", path);
+    return false;
+  }
+
+  releaseMap();
+  mappedFile = p;
+  mappedSize = st.st_size;
+
+  uint8_t *base = (uint8_t *)p;
+  setLevel(h, base + h.tilesOffset,
+           (const MapSpawn *)(base + h.spawnsOffset));
+  rebuildOccupancyGrid();
+
+  printf("Loaded map %s: %dx%d, %d spawn points\n", path, level.width,
+         level.height, level.spawnCount);
+  return true;
+}
+
+void unloadMap() {
+  releaseMap();
+  level = builtinLevel;
+  rebuildOccupancyGrid();
+}
+
 int getMapTile(int y, int x) {
-  if (x < 0 || y < 0 || x >= MAP_SIZE || y >= MAP_SIZE)
+  if (x < 0 || y < 0 || x >= level.width || y >= level.height)
     return 1;
-  return map[y][x];
+  if (!level.tiles) {
+    const TileChunk *chunk = chunkAt(y, x);
+    return chunk ? chunk->tiles[chunkCell(y, x)] : MAP_TILE_WALL;
+  }
+  return level.tiles[y * level.width + x];
+}
+
+OccupancyGrid occupancy;
+
+static void setOccupied(int y, int x, bool solid) {
+  unsigned bx = x + 1;
+  unsigned by = y + 1;
+  uint32_t &word = occupancy.bits[by * occupancy.stride + (bx >> 5)];
+  uint32_t bit = 1u << (bx & 31);
+  word = solid ? word | bit : word & ~bit;
+}
+
+// Two chamfer passes with unit weights to all 8 neighbours, which gives the
+// exact Chebyshev distance. The border is solid, so every cell is bounded.
+static void buildWallDistance() {
+  int w = occupancy.width + 2;
+  int h = occupancy.height + 2;
+  std::vector<uint8_t> &dist = occupancy.wallDistance;
+  dist.assign((size_t)w * h, 255);
+
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      uint8_t &d = dist[y * w + x];
+      if (isSolid(y - 1, x - 1)) {
+        d = 0;
+        continue;
+      }
+      int best = d;
+      if (x > 0)
+        best = std::min(best, dist[y * w + x - 1] + 1);
+      if (y > 0) {
+        const uint8_t *up = &dist[(y - 1) * w + x];
+        best = std::min(best, up[0] + 1);
+        if (x > 0)
+          best = std::min(best, up[-1] + 1);
+        if (x + 1 < w)
+          best = std::min(best, up[1] + 1);
+      }
+      d = (uint8_t)std::min(best, 255);
+    }
+  }
+
+  for (int y = h - 1; y >= 0; y--) {
+    for (int x = w - 1; x >= 0; x--) {
+      uint8_t &d = dist[y * w + x];
+      int best = d;
+      if (x + 1 < w)
+        best = std::min(best, dist[y * w + x + 1] + 1);
+      if (y + 1 < h) {
+        const uint8_t *down = &dist[(y + 1) * w + x];
+        best = std::min(best, down[0] + 1);
+        if (x > 0)
+          best = std::min(best, down[-1] + 1);
+        if (x + 1 < w)
+          best = std::min(best, down[1] + 1);
+      }
+      d = (uint8_t)std::min(best, 255);
+    }
+  }
+}
+
+void buildOccupancyGrid(int width, int height, const uint8_t *tiles) {
+  occupancy.chunks = nullptr;
+  occupancy.width = width;
+  occupancy.height = height;
+  occupancy.stride = (width + 2 + 31) / 32;
+  occupancy.bits.assign((size_t)occupancy.stride * (height + 2), 0);
+
+  for (int y = -1; y <= height; y++) {
+    for (int x = -1; x <= width; x++) {
+      bool inside = x >= 0 && y >= 0 && x < width && y < height;
+      setOccupied(y, x, !inside || tiles[y * width + x] == MAP_TILE_WALL);
+    }
+  }
+  buildWallDistance();
+}
+
+void rebuildOccupancyGrid() {
+  if (!level.tiles)
+    return; // streamed chunks build their own as they load
+  buildOccupancyGrid(level.width, level.height, level.tiles);
+}
+
+// level is constant-initialised, so this sees the finished built-in level
+[[maybe_unused]] static bool occupancyBuilt = (rebuildOccupancyGrid(), true);
+
+void setMapTile(int y, int x, int tile) {
+  if (x < 0 || y < 0 || x >= level.width || y >= level.height)
+    return;
+  if (!level.tiles) {
+    setChunkTile(y, x, tile);
+    return;
+  }
+  level.tiles[y * level.width + x] = tile;
+  setOccupied(y, x, tile == MAP_TILE_WALL);
+  buildWallDistance(); // a whole pass, but tiles rarely change
 }
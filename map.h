@@ -1,5 +1,98 @@
 #pragma once
-#define MAP_SIZE 24
+#include "mapfile.h"
+#include "mapstream.h"
+#include <cstdint>
+#include <vector>
 
-extern int map[MAP_SIZE][MAP_SIZE];
-int getMapTile(int y, int x);
+// The level being played: the built-in one until loadMap replaces it.
+// Tiles are one byte per cell, row-major; for a loaded map they point
+// straight into the mapped file. Streamed maps have no tiles here, only the
+// resident chunks (see mapstream.h).
+struct Level {
+  int width;
+  int height;
+  uint8_t *tiles; // null for streamed maps
+  const MapSpawn *spawns; // enemy spawn points
+  int spawnCount;
+  float startX; // player start
+  float startY;
+  float startAngle;
+};
+
+extern Level level;
+
+// Maps a binary map file (see mapfile.h) and makes it the current level.
+// The mapping is copy-on-write, so setMapTile never touches the file. Maps
+// longer than MAP_STREAM_SIZE on a side are streamed instead. On failure
+// the current level is left as it was.
+bool loadMap(const char *path);
+void unloadMap(); // back to the built-in level
+
+int getMapTile(int y, int x); // walls outside the level
+
+// Changes a tile and keeps the occupancy grid in step with it
+void setMapTile(int y, int x, int tile);
+
+// Occupancy grid: one bit per cell, set for walls, with a solid border one
+// cell wide around the map. Anything that moves at most one cell past the
+// edge of the map lands on the border, so lookups need no bounds checks.
+//
+// Alongside it is a distance field: for every cell, the Chebyshev distance
+// to the nearest wall or border cell (0 for walls, 1 next to one, capped at
+// 255). A cell at distance d sits in an empty square reaching d - 1 cells
+// out each way, which rays use to jump across open space.
+//
+// Streamed maps leave bits and wallDistance empty and look cells up in the
+// resident chunks instead, through the same functions.
+struct OccupancyGrid {
+  int width;  // map cells, not counting the border
+  int height;
+  int stride; // 32-bit words per row of bits
+  std::vector<uint32_t> bits;        // (height + 2) rows of stride words
+  std::vector<uint8_t> wallDistance; // (height + 2) x (width + 2)
+
+  TileChunk *const *chunks; // chunk table of a streamed map, else null
+  int chunksWide;
+};
+
+extern OccupancyGrid occupancy;
+
+// Built from the level at startup and by loadMap; rebuild it after writing
+// level.tiles directly. buildOccupancyGrid fills it from any row-major tile
+// array instead.
+void rebuildOccupancyGrid();
+void buildOccupancyGrid(int width, int height, const uint8_t *tiles);
+
+// Resident chunk holding cell (x, y) of a streamed map, or null
+inline const TileChunk *chunkAt(int y, int x) {
+  if ((unsigned)x >= (unsigned)occupancy.width ||
+      (unsigned)y >= (unsigned)occupancy.height)
+    return nullptr;
+  return occupancy.chunks[(y >> CHUNK_SHIFT) * occupancy.chunksWide +
+                          (x >> CHUNK_SHIFT)];
+}
+
+inline int chunkCell(int y, int x) {
+  return (y & CHUNK_MASK) * CHUNK_SIZE + (x & CHUNK_MASK);
+}
+
+// Unchecked: x must be in [-1, width] and y in [-1, height]
+inline bool isSolid(int y, int x) {
+  if (occupancy.chunks) {
+    const TileChunk *chunk = chunkAt(y, x);
+    int i = chunkCell(y, x);
+    return !chunk || ((chunk->bits[i >> 5] >> (i & 31)) & 1);
+  }
+
+  unsigned bx = x + 1;
+  unsigned by = y + 1;
+  return (occupancy.bits[by * occupancy.stride + (bx >> 5)] >> (bx & 31)) & 1;
+}
+
+inline int wallDistance(int y, int x) {
+  if (occupancy.chunks) {
+    const TileChunk *chunk = chunkAt(y, x);
+    return chunk ? chunk->wallDistance[chunkCell(y, x)] : 0;
+  }
+  return occupancy.wallDistance[(y + 1) * (occupancy.width + 2) + (x + 1)];
+}
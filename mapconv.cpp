@@ -0,0 +1,165 @@
+// mapconv.cpp - Converts a text map layout into the binary map format the
+// game loads (see mapfile.h).
+//
+//   mapconv maps/castle.txt castle.map
+//
+// One line per row of cells:
+//   '#'             wall
+//   '.' or ' '      floor
+//   'E'             floor with an enemy spawn point
+//   '>' 'v' '<' '^' floor with the player start, facing east, south, west
+//                   or north
+// Lines starting with ';' are comments. Short rows are padded with floor;
+// the game puts a solid border round the map, so the edge needn't be walls.
+#include "mapfile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct TextMap {
+  int width = 0;
+  int height = 0;
+  std::vector<uint8_t> tiles;
+  std::vector<MapSpawn> spawns;
+  bool hasStart = false;
+  float startX = 0.0f;
+  float startY = 0.0f;
+  float startAngle = 0.0f;
+};
+
+static bool readRows(const char *path, std::vector<std::string> &rows) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    printf("ERROR: Could not open %s\n", path);
+    return false;
+  }
+
+  char line[MAP_MAX_SIZE + 2];
+  while (fgets(line, sizeof(line), f)) {
+    size_t length = strcspn(line, "\r\n");
+    if (length == strlen(line) && !feof(f)) {
+      printf("ERROR: %s: row %zu is wider than %d cells\n", path,
+             rows.size() + 1, MAP_MAX_SIZE);
+      fclose(f);
+      return false;
+    }
+    line[length] = '\0';
+    if (line[0] != ';')
+      rows.push_back(line);
+  }
+  fclose(f);
+  return true;
+}
+
+static bool parseMap(const char *path, TextMap &map) {
+  std::vector<std::string> rows;
+  if (!readRows(path, rows))
+    return false;
+
+  map.height = (int)rows.size();
+  for (const std::string &row : rows)
+    map.width = std::max(map.width, (int)row.size());
+  if (map.width < 1 || map.height < 1 || map.height > MAP_MAX_SIZE) {
+    printf("ERROR: %s: map must be 1 to %d cells along each side\n", path,
+           MAP_MAX_SIZE);
+    return false;
+  }
+
+  map.tiles.assign((size_t)map.width * map.height, MAP_TILE_EMPTY);
+  for (int y = 0; y < map.height; y++) {
+    for (int x = 0; x < (int)rows[y].size(); x++) {
+      float cx = x + 0.5f;
+      float cy = y + 0.5f;
+
+      switch (rows[y][x]) {
+      case '#':
+        map.tiles[y * map.width + x] = MAP_TILE_WALL;
+        break;
+      case '.':
+      case ' ':
+        break;
+      case 'E':
+        map.spawns.push_back({cx, cy});
+        break;
+      case '>':
+      case '<':
+      case 'v':
+      case '^': {
+        // Map y grows southwards, so south is +90 degrees
+        static const char arrows[] = "><v^";
+        static const float angles[] = {0.0f, (float)M_PI, (float)M_PI / 2.0f,
+                                       -(float)M_PI / 2.0f};
+        map.hasStart = true;
+        map.startX = cx;
+        map.startY = cy;
+        map.startAngle = angles[strchr(arrows, rows[y][x]) - arrows];
+        break;
+      }
+      default:
+        printf("ERROR: %s: unknown tile '%c' at row %d, column %d\n", path,
+               rows[y][x], y + 1, x + 1);
+        return false;
+      }
+    }
+  }
+
+  if (!map.hasStart) {
+    printf("ERROR: %s: no player start ('>', 'v', '<' or '^')\n", path);
+    return false;
+  }
+  return true;
+}
+
+static bool writeMap(const char *path, const TextMap &map) {
+  MapFileHeader header = {};
+  header.magic = MAP_FILE_MAGIC;
+  header.version = MAP_FILE_VERSION;
+  header.width = map.width;
+  header.height = map.height;
+  header.tileTypes = MAP_TILE_TYPES;
+  header.spawnCount = (uint32_t)map.spawns.size();
+  header.startX = map.startX;
+  header.startY = map.startY;
+  header.startAngle = map.startAngle;
+  header.tilesOffset = sizeof(MapFileHeader);
+  header.spawnsOffset =
+      (header.tilesOffset + (uint32_t)map.tiles.size() + 3) & ~3u;
+
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    printf("ERROR: Could not create %s\n", path);
+    return false;
+  }
+
+  static const uint8_t padding[4] = {};
+  size_t padBytes =
+      header.spawnsOffset - header.tilesOffset - map.tiles.size();
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(map.tiles.data(), 1, map.tiles.size(), f) ==
+                map.tiles.size() &&
+            fwrite(padding, 1, padBytes, f) == padBytes &&
+            fwrite(map.spawns.data(), sizeof(MapSpawn), map.spawns.size(),
+                   f) == map.spawns.size();
+  ok = fclose(f) == 0 && ok;
+  if (!ok)
+    printf("ERROR: Could not write %s\n", path);
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 3) {
+    printf("Usage: mapconv LAYOUT.txt OUT.map\n");
+    return 1;
+  }
+
+  TextMap map;
+  if (!parseMap(argv[1], map) || !writeMap(argv[2], map))
+    return 1;
+
+  printf("%s: %dx%d, %zu spawn points\n", argv[2], map.width, map.height,
+         map.spawns.size());
+  return 0;
+}
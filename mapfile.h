@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+
+// Binary map file, written by mapconv and used in place by loadMap through
+// mmap, so nothing in it needs parsing; maps too big to keep whole are read
+// a chunk at a time instead (see mapstream.h). Little-endian, laid out as:
+//
+//   MapFileHeader
+//   width * height tile bytes, row-major, each below tileTypes
+//   padding up to a multiple of 4
+//   spawnCount MapSpawn records
+#define MAP_FILE_MAGIC 0x50414D44 // "DMAP"
+#define MAP_FILE_VERSION 1
+#define MAP_MAX_SIZE 32768 // cells along either side
+
+// Tile types
+#define MAP_TILE_EMPTY 0
+#define MAP_TILE_WALL 1
+#define MAP_TILE_TYPES 2
+
+struct MapSpawn {
+  float x;
+  float y;
+};
+
+struct MapFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t tileTypes;
+  uint32_t spawnCount; // enemy spawn points
+  float startX;        // player start
+  float startY;
+  float startAngle;
+  uint32_t tilesOffset;  // from the start of the file
+  uint32_t spawnsOffset; // 4-byte aligned
+};
+
+static_assert(sizeof(MapFileHeader) == 44, "map file header layout");
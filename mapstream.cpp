@@ -0,0 +1,318 @@
+#include "mapstream.h"
+#include "map.h"
+#include "renderer.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+enum ChunkState : uint8_t { CHUNK_ABSENT, CHUNK_LOADING, CHUNK_RESIDENT };
+
+static int mapFd = -1;
+static MapFileHeader mapHeader;
+static int chunksWide = 0;
+static int chunksHigh = 0;
+
+// Owned by the frame thread
+static std::vector<TileChunk *> chunkTable; // resident chunks, by index
+static std::vector<uint8_t> chunkState;
+static std::vector<TileChunk> chunkPool; // every chunk there will ever be
+static std::vector<TileChunk *> freeChunks;
+static std::vector<TileChunk *> residentChunks;
+
+// Shared with the loader thread
+static std::thread loaderThread;
+static std::mutex loaderMutex;
+static std::condition_variable requestCond; // a chunk was asked for or stop
+static std::condition_variable loadedCond;  // a chunk finished loading
+static std::deque<TileChunk *> loadRequests;
+static std::deque<TileChunk *> loadedChunks;
+static bool loaderStopping = false;
+
+// Everything within MAX_DIST is needed for the current view; the extra
+// chunk covers the player walking on while the loader catches up
+static float prefetchRadius() { return MAX_DIST + CHUNK_SIZE; }
+
+// Chunks are kept a little past that so walking back and forth along a
+// chunk edge doesn't reload them every frame
+static float keepRadius() { return prefetchRadius() + CHUNK_SIZE / 2; }
+
+// True if chunk `index` overlaps the square reaching `radius` cells from
+// (x, y)
+static bool chunkInReach(int index, float x, float y, float radius) {
+  float left = (float)(index % chunksWide * CHUNK_SIZE);
+  float top = (float)(index / chunksWide * CHUNK_SIZE);
+  return left <= x + radius && left + CHUNK_SIZE > x - radius &&
+         top <= y + radius && top + CHUNK_SIZE > y - radius;
+}
+
+// Same two chamfer passes as the whole-map field, but every cell starts at
+// its distance to the chunk edge plus one, so the empty square a distance
+// promises always stays inside the chunk
+static void buildChunkDistance(TileChunk *chunk) {
+  uint8_t *dist = chunk->wallDistance;
+  for (int y = 0; y < CHUNK_SIZE; y++) {
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+      int i = y * CHUNK_SIZE + x;
+      int edge = std::min(std::min(x, CHUNK_MASK - x),
+                          std::min(y, CHUNK_MASK - y));
+      dist[i] = (chunk->bits[i >> 5] >> (i & 31)) & 1 ? 0 : edge + 1;
+    }
+  }
+
+  for (int y = 0; y < CHUNK_SIZE; y++) {
+    for (int x = 0; x < CHUNK_SIZE; x++) {
+      int i = y * CHUNK_SIZE + x;
+      int best = dist[i];
+      if (x > 0)
+        best = std::min(best, dist[i - 1] + 1);
+      if (y > 0) {
+        best = std::min(best, dist[i - CHUNK_SIZE] + 1);
+        if (x > 0)
+          best = std::min(best, dist[i - CHUNK_SIZE - 1] + 1);
+        if (x < CHUNK_MASK)
+          best = std::min(best, dist[i - CHUNK_SIZE + 1] + 1);
+      }
+      dist[i] = (uint8_t)best;
+    }
+  }
+
+  for (int y = CHUNK_MASK; y >= 0; y--) {
+    for (int x = CHUNK_MASK; x >= 0; x--) {
+      int i = y * CHUNK_SIZE + x;
+      int best = dist[i];
+      if (x < CHUNK_MASK)
+        best = std::min(best, dist[i + 1] + 1);
+      if (y < CHUNK_MASK) {
+        best = std::min(best, dist[i + CHUNK_SIZE] + 1);
+        if (x > 0)
+          best = std::min(best, dist[i + CHUNK_SIZE - 1] + 1);
+        if (x < CHUNK_MASK)
+          best = std::min(best, dist[i + CHUNK_SIZE + 1] + 1);
+      }
+      dist[i] = (uint8_t)best;
+    }
+  }
+}
+
+// Loader thread: reads the chunk's rows out of the map file and builds its
+// occupancy bits and distance field. Cells past the edge of the map, or
+// that can't be read, are walls.
+static void loadChunk(TileChunk *chunk) {
+  int x0 = chunk->index % chunksWide * CHUNK_SIZE;
+  int y0 = chunk->index / chunksWide * CHUNK_SIZE;
+  int cols = std::min(CHUNK_SIZE, (int)mapHeader.width - x0);
+  int rows = std::min(CHUNK_SIZE, (int)mapHeader.height - y0);
+
+  memset(chunk->tiles, MAP_TILE_WALL, sizeof(chunk->tiles));
+  for (int y = 0; y < rows; y++) {
+    uint8_t *row = &chunk->tiles[y * CHUNK_SIZE];
+    off_t offset = mapHeader.tilesOffset +
+                   (off_t)(y0 + y) * mapHeader.width + x0;
+    if (pread(mapFd, row, cols, offset) != cols) {
+      printf("WARNING: Could not read map row %d\n", y0 + y);
+      memset(row, MAP_TILE_WALL, cols);
+    }
+  }
+
+  memset(chunk->bits, 0, sizeof(chunk->bits));
+  for (int i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++) {
+    if (chunk->tiles[i] == MAP_TILE_WALL)
+      chunk->bits[i >> 5] |= 1u << (i & 31);
+  }
+  buildChunkDistance(chunk);
+}
+
+static void loaderLoop() {
+  for (;;) {
+    TileChunk *chunk;
+    {
+      std::unique_lock<std::mutex> lock(loaderMutex);
+      requestCond.wait(lock, [] {
+        return loaderStopping || !loadRequests.empty();
+      });
+      if (loaderStopping)
+        return;
+      chunk = loadRequests.front();
+      loadRequests.pop_front();
+    }
+
+    loadChunk(chunk);
+
+    {
+      std::lock_guard<std::mutex> lock(loaderMutex);
+      loadedChunks.push_back(chunk);
+    }
+    loadedCond.notify_all();
+  }
+}
+
+void updateMapStreaming(float x, float y) {
+  if (mapFd < 0)
+    return;
+
+  float keep = keepRadius();
+  float prefetch = prefetchRadius();
+
+  // Install what the loader finished, unless the player has moved on
+  std::deque<TileChunk *> loaded;
+  {
+    std::lock_guard<std::mutex> lock(loaderMutex);
+    loaded.swap(loadedChunks);
+  }
+  for (TileChunk *chunk : loaded) {
+    if (chunkInReach(chunk->index, x, y, keep)) {
+      chunkTable[chunk->index] = chunk;
+      chunkState[chunk->index] = CHUNK_RESIDENT;
+      residentChunks.push_back(chunk);
+    } else {
+      chunkState[chunk->index] = CHUNK_ABSENT;
+      freeChunks.push_back(chunk);
+    }
+  }
+
+  // Drop chunks that are out of reach
+  for (size_t i = 0; i < residentChunks.size();) {
+    TileChunk *chunk = residentChunks[i];
+    if (chunkInReach(chunk->index, x, y, keep)) {
+      i++;
+      continue;
+    }
+    chunkTable[chunk->index] = nullptr;
+    chunkState[chunk->index] = CHUNK_ABSENT;
+    freeChunks.push_back(chunk);
+    residentChunks[i] = residentChunks.back();
+    residentChunks.pop_back();
+  }
+
+  // Ask for the missing chunks within reach, nearest first
+  int cx0 = std::max(0, (int)((x - prefetch) / CHUNK_SIZE));
+  int cy0 = std::max(0, (int)((y - prefetch) / CHUNK_SIZE));
+  int cx1 = std::min(chunksWide - 1, (int)((x + prefetch) / CHUNK_SIZE));
+  int cy1 = std::min(chunksHigh - 1, (int)((y + prefetch) / CHUNK_SIZE));
+
+  std::vector<int> wanted;
+  for (int cy = cy0; cy <= cy1; cy++) {
+    for (int cx = cx0; cx <= cx1; cx++) {
+      if (chunkState[cy * chunksWide + cx] == CHUNK_ABSENT)
+        wanted.push_back(cy * chunksWide + cx);
+    }
+  }
+  if (wanted.empty())
+    return;
+
+  auto distance = [&](int index) {
+    float dx = (index % chunksWide + 0.5f) * CHUNK_SIZE - x;
+    float dy = (index / chunksWide + 0.5f) * CHUNK_SIZE - y;
+    return dx * dx + dy * dy;
+  };
+  std::sort(wanted.begin(), wanted.end(),
+            [&](int a, int b) { return distance(a) < distance(b); });
+
+  {
+    std::lock_guard<std::mutex> lock(loaderMutex);
+    for (int index : wanted) {
+      if (freeChunks.empty())
+        break; // the rest wait for chunks further out to be dropped
+      TileChunk *chunk = freeChunks.back();
+      freeChunks.pop_back();
+      chunk->index = index;
+      chunkState[index] = CHUNK_LOADING;
+      loadRequests.push_back(chunk);
+    }
+  }
+  requestCond.notify_one();
+}
+
+void openStreamedMap(int fd, const MapFileHeader &header, float startX,
+                     float startY) {
+  closeStreamedMap();
+
+  mapFd = fd;
+  mapHeader = header;
+  chunksWide = (header.width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  chunksHigh = (header.height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  chunkTable.assign((size_t)chunksWide * chunksHigh, nullptr);
+  chunkState.assign((size_t)chunksWide * chunksHigh, CHUNK_ABSENT);
+
+  // Enough chunks to cover the kept square wherever it lies on the grid
+  int span = (int)(2.0f * keepRadius() / CHUNK_SIZE) + 2;
+  chunkPool.assign((size_t)span * span, TileChunk());
+  for (TileChunk &chunk : chunkPool)
+    freeChunks.push_back(&chunk);
+
+  occupancy.width = header.width;
+  occupancy.height = header.height;
+  occupancy.stride = 0;
+  occupancy.bits.clear();
+  occupancy.bits.shrink_to_fit();
+  occupancy.wallDistance.clear();
+  occupancy.wallDistance.shrink_to_fit();
+  occupancy.chunks = chunkTable.data();
+  occupancy.chunksWide = chunksWide;
+
+  loaderStopping = false;
+  loaderThread = std::thread(loaderLoop);
+
+  // Wait for the first batch so the start of the level is there
+  updateMapStreaming(startX, startY);
+  size_t requested = chunkPool.size() - freeChunks.size();
+  {
+    std::unique_lock<std::mutex> lock(loaderMutex);
+    loadedCond.wait(lock, [&] { return loadedChunks.size() == requested; });
+  }
+  updateMapStreaming(startX, startY);
+
+  printf("Streaming %dx%d map in %dx%d chunks, at most %d resident\n",
+         header.width, header.height, CHUNK_SIZE, CHUNK_SIZE,
+         maxResidentChunks());
+}
+
+void closeStreamedMap() {
+  if (loaderThread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(loaderMutex);
+      loaderStopping = true;
+    }
+    requestCond.notify_all();
+    loaderThread.join();
+  }
+
+  if (mapFd >= 0) {
+    close(mapFd);
+    mapFd = -1;
+    occupancy.chunks = nullptr;
+  }
+
+  loadRequests.clear();
+  loadedChunks.clear();
+  chunkTable.clear();
+  chunkState.clear();
+  freeChunks.clear();
+  residentChunks.clear();
+  chunkPool.clear();
+}
+
+int residentChunkCount() { return (int)residentChunks.size(); }
+int maxResidentChunks() { return (int)chunkPool.size(); }
+
+void setChunkTile(int y, int x, int tile) {
+  if (!occupancy.chunks || !chunkAt(y, x))
+    return;
+
+  TileChunk *chunk =
+      chunkTable[(y >> CHUNK_SHIFT) * chunksWide + (x >> CHUNK_SHIFT)];
+  int i = chunkCell(y, x);
+  uint32_t bit = 1u << (i & 31);
+  chunk->tiles[i] = tile;
+  if (tile == MAP_TILE_WALL)
+    chunk->bits[i >> 5] |= bit;
+  else
+    chunk->bits[i >> 5] &= ~bit;
+  buildChunkDistance(chunk);
+}
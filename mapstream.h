@@ -0,0 +1,47 @@
+#pragma once
+#include "mapfile.h"
+#include <cstdint>
+
+// Streamed maps: levels too big to keep resident are split into 64x64
+// chunks, and only the chunks around the player are in memory. A loader
+// thread reads them from the map file; the frame thread installs finished
+// chunks and drops far ones in updateMapStreaming, between frames, so
+// isSolid and friends never see a chunk change under them.
+//
+// Chunks are requested within MAX_DIST plus one chunk of the player, so
+// everything the view can show is resident even while the player walks a
+// chunk ahead of the loader, and dropped once they are half a chunk further
+// out than that. Cells in chunks that aren't resident read as walls.
+#define CHUNK_SHIFT 6
+#define CHUNK_SIZE (1 << CHUNK_SHIFT) // cells along each side
+#define CHUNK_MASK (CHUNK_SIZE - 1)
+
+// Maps with a side longer than this are streamed
+#define MAP_STREAM_SIZE 2048
+
+struct TileChunk {
+  uint32_t bits[CHUNK_SIZE * CHUNK_SIZE / 32]; // occupancy, 2 words per row
+  // Chebyshev distance to the nearest wall, capped so the empty square it
+  // promises never reaches past the chunk edge
+  uint8_t wallDistance[CHUNK_SIZE * CHUNK_SIZE];
+  uint8_t tiles[CHUNK_SIZE * CHUNK_SIZE];
+  int index; // chunkY * chunksWide + chunkX
+};
+
+// Takes over `fd` (closed by closeStreamedMap) and loads the chunks around
+// (startX, startY) before returning, so the first frame has its world
+void openStreamedMap(int fd, const MapFileHeader &header, float startX,
+                     float startY);
+void closeStreamedMap();
+
+// Frame thread, between frames: installs loaded chunks, drops far ones and
+// asks for the ones (x, y) now needs
+void updateMapStreaming(float x, float y);
+
+// Resident chunks, and the most there can ever be
+int residentChunkCount();
+int maxResidentChunks();
+
+// Changes a tile in a resident chunk (ignored otherwise). The edit only
+// lasts until the chunk is dropped.
+void setChunkTile(int y, int x, int tile);
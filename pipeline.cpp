@@ -0,0 +1,90 @@
+#include "pipeline.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+static std::thread frameThread;
+static std::mutex pipelineMutex;
+static std::condition_variable emptyCond;    // a buffer was queued or stop
+static std::condition_variable finishedCond; // a frame finished
+
+static std::deque<int> emptyBuffers;    // owned by the frame thread, unused
+static std::deque<int> finishedBuffers; // drawn, waiting for the presenter
+static bool boundedLatency = false;
+static bool stopping = false;
+
+static void frameLoop(FrameJob job, void *userData) {
+  for (;;) {
+    int buffer;
+    {
+      std::unique_lock<std::mutex> lock(pipelineMutex);
+      emptyCond.wait(lock, [] {
+        return stopping || (!emptyBuffers.empty() &&
+                            !(boundedLatency && !finishedBuffers.empty()));
+      });
+      if (stopping)
+        return;
+      buffer = emptyBuffers.front();
+      emptyBuffers.pop_front();
+    }
+
+    job(userData, buffer);
+
+    {
+      std::lock_guard<std::mutex> lock(pipelineMutex);
+      finishedBuffers.push_back(buffer);
+    }
+    finishedCond.notify_one();
+  }
+}
+
+void startFramePipeline(bool boundLatency, FrameJob job, void *userData) {
+  stopFramePipeline();
+
+  emptyBuffers.clear();
+  finishedBuffers.clear();
+  boundedLatency = boundLatency;
+  stopping = false;
+  frameThread = std::thread(frameLoop, job, userData);
+}
+
+void stopFramePipeline() {
+  if (!frameThread.joinable())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(pipelineMutex);
+    stopping = true;
+  }
+  emptyCond.notify_all();
+  frameThread.join();
+
+  emptyBuffers.clear();
+  finishedBuffers.clear();
+}
+
+void queueFrameBuffer(int buffer) {
+  {
+    std::lock_guard<std::mutex> lock(pipelineMutex);
+    emptyBuffers.push_back(buffer);
+  }
+  emptyCond.notify_one();
+}
+
+int takeFinishedFrame(int timeoutMs) {
+  int buffer;
+  {
+    std::unique_lock<std::mutex> lock(pipelineMutex);
+    if (!finishedCond.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                               [] { return !finishedBuffers.empty(); }))
+      return -1;
+    buffer = finishedBuffers.front();
+    finishedBuffers.pop_front();
+  }
+
+  // With the latency bound the frame thread may be waiting on this
+  emptyCond.notify_one();
+  return buffer;
+}
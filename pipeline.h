@@ -0,0 +1,30 @@
+#pragma once
+
+// Two (or three) stage frame pipeline. A frame thread simulates and renders
+// into one frame buffer while the presenting thread shows the previous one,
+// so presentation and vsync waits no longer hold up the next frame.
+//
+// Buffers are named by index and always have exactly one owner:
+//   presenter -> queueFrameBuffer()   -> frame thread draws into it
+//   frame thread finishes             -> takeFinishedFrame() -> presenter
+// The presenter must not touch a buffer between handing it over and getting
+// it back, and the frame job must only touch the buffer it was given.
+#define MAX_PIPELINE_BUFFERS 3
+
+// Runs on the frame thread: simulate and render into buffer `buffer`
+typedef void (*FrameJob)(void *userData, int buffer);
+
+// Starts the frame thread with every buffer owned by the presenter. With
+// boundLatency the frame thread doesn't start a frame while a finished one
+// is still waiting to be taken, so at most one frame is ever queued ahead of
+// the screen; otherwise it runs ahead as far as the free buffers allow.
+void startFramePipeline(bool boundLatency, FrameJob job, void *userData);
+
+// Lets the current frame finish, then joins the frame thread. Every buffer,
+// drawn or not, belongs to the presenter again.
+void stopFramePipeline();
+
+// Presenter side
+void queueFrameBuffer(int buffer);
+// Oldest finished frame, or -1 if none finishes within timeoutMs
+int takeFinishedFrame(int timeoutMs);
@@ -2,7 +2,10 @@
 #include "enemy.h"
 #include "gun.h"
 #include "map.h"
+#include "renderer.h"
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
 float playerX = 2.5f;
 float playerY = 2.5f;
 float playerAngle = M_PI / 4.0f; // Facing diagonal
@@ -14,6 +17,9 @@ static bool strafeRight = false;
 static bool turnLeft = false;
 static bool turnRight = false;
 
+// The fire key was pressed and the blast hasn't been resolved yet
+static bool shotPending = false;
+
 void handlePlayerInput(SDL_Keycode key, bool pressed) {
   // Movement
   if (key == SDLK_w)
@@ -34,11 +40,31 @@ void handlePlayerInput(SDL_Keycode key, bool pressed) {
   // Actions
   if (key == SDLK_r && pressed)
     startReload();
-  if (key == SDLK_SPACE && pressed) {
-    startShoot();
-    int hitEnemy = hitscanCheckEnemy(); // ADD THIS
+  if (key == SDLK_SPACE && pressed && startShoot())
+    shotPending = true;
+}
+
+void fireShot(const RenderContext *view) {
+  if (!shotPending)
+    return;
+  shotPending = false;
+
+  float planeLength = tanf(FOV / 2.0f);
+  for (int i = 0; i < SHOTGUN_PELLETS; i++) {
+    float spread = SHOTGUN_SPREAD * ((rand() % 2001) / 1000.0f - 1.0f);
+
+    int hitEnemy;
+    if (view->entityIds) {
+      // The column whose ray points `spread` off the view direction, on
+      // the crosshair's row
+      int x = (int)(view->width * (0.5f + 0.5f * tanf(spread) / planeLength));
+      hitEnemy = pickEnemy(view, x, view->height / 2);
+    } else {
+      hitEnemy = hitscanCheckEnemy(playerAngle + spread);
+    }
+
     if (hitEnemy != -1) {
-      damageEnemy(hitEnemy, 170); // Deal 25 damage
+      damageEnemy(hitEnemy, SHOTGUN_PELLET_DAMAGE);
       printf("Hit enemy %d!\n", hitEnemy);
     }
   }
@@ -47,13 +73,13 @@ void handlePlayerInput(SDL_Keycode key, bool pressed) {
 // Better collision check with radius
 static bool checkCollision(float x, float y, float radius = 0.3f) {
   // Check 4 corners of player bounding box
-  if (getMapTile((int)(y - radius), (int)(x - radius)) == 1)
+  if (isSolid((int)(y - radius), (int)(x - radius)))
     return true;
-  if (getMapTile((int)(y - radius), (int)(x + radius)) == 1)
+  if (isSolid((int)(y - radius), (int)(x + radius)))
     return true;
-  if (getMapTile((int)(y + radius), (int)(x - radius)) == 1)
+  if (isSolid((int)(y + radius), (int)(x - radius)))
     return true;
-  if (getMapTile((int)(y + radius), (int)(x + radius)) == 1)
+  if (isSolid((int)(y + radius), (int)(x + radius)))
     return true;
   return false;
 }
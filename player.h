@@ -1,4 +1,5 @@
 #pragma once
+#include "rendercontext.h"
 #include <SDL2/SDL.h>
 
 extern float playerX;
@@ -7,3 +8,7 @@ extern float playerAngle;
 
 void handlePlayerInput(SDL_Keycode key, bool pressed);
 void updatePlayer(float deltaTime);
+// Fires the shotgun blast the fire key started, if any, at the frame just
+// drawn into `view`: each pellet hits whatever enemy view's entity IDs
+// show at its spread point, or without IDs whatever a ray test finds
+void fireShot(const RenderContext *view);
@@ -1,4 +1,5 @@
 #include "projectile.h"
+#include "billboard.h"
 #include "map.h"
 #include "player.h"
 #include <cmath>
@@ -12,6 +13,7 @@ static const float PROJECTILE_SPEED = 4.0f;
 static const float PROJECTILE_MAX_LIFETIME = 3.0f;
 static const float PROJECTILE_COLLISION_RADIUS = 0.3f;
 const float PROJECTILE_HEIGHT_OFFSET = 0.10f; // units above ground
+static const float PROJECTILE_SIZE = 0.6f;    // world units tall
 static const char frameLetters[PROJECTILE_MAX_FRAMES] = {
     'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K'};
 
@@ -90,20 +92,14 @@ void cleanupProjectileSprites() {
     if (frameHasAngles[f]) {
       // Clean up all angles for A and B
       for (int a = 0; a < 8; a++) {
-        if (projectileSprites[f][a].pixels) {
-          delete[] projectileSprites[f][a].pixels;
-          projectileSprites[f][a].pixels = nullptr;
-        }
+        freeSprite(&projectileSprites[f][a]);
       }
     } else {
       // Only clean up the first sprite for C-K (others are copies)
-      if (projectileSprites[f][0].pixels) {
-        delete[] projectileSprites[f][0].pixels;
-        projectileSprites[f][0].pixels = nullptr;
-      }
+      freeSprite(&projectileSprites[f][0]);
       // Clear the copied references
       for (int a = 1; a < 8; a++) {
-        projectileSprites[f][a].pixels = nullptr;
+        projectileSprites[f][a] = Sprite();
       }
     }
   }
@@ -205,7 +201,7 @@ void updateProjectiles(float dt) {
     p.distanceTraveled += sqrtf(dx * dx + dy * dy);
 
     // Wall collision
-    if (getMapTile((int)p.y, (int)p.x) == 1) {
+    if (isSolid((int)p.y, (int)p.x)) {
       p.active = false;
       continue;
     }
@@ -249,72 +245,28 @@ bool checkProjectilePlayerHit(float playerX, float playerY, float radius) {
   return false;
 }
 
-void renderProjectiles(uint32_t *pixels, int screenWidth, int screenHeight,
-                       float *zBuffer) {
-  int w = screenWidth;
-  int h = screenHeight;
-  const float FOV = M_PI / 3.0f;
-
+void addProjectileBillboards() {
   for (int i = 0; i < PROJECTILE_MAX_ACTIVE; i++) {
     Projectile &p = projectiles[i];
     if (!p.active)
       continue;
 
-    float dx = p.x - playerX;
-    float dy = p.y - playerY;
-    float dist = sqrtf(dx * dx + dy * dy);
-
-    if (dist < 0.1f)
-      continue;
-
-    float angleToProj = atan2f(dy, dx);
-    float relAngle = angleToProj - playerAngle;
-
-    while (relAngle < -M_PI)
-      relAngle += 2 * M_PI;
-    while (relAngle > M_PI)
-      relAngle -= 2 * M_PI;
-
-    if (fabs(relAngle) > FOV * 0.5f)
-      continue;
-
-    // Calculate sprite angle (only matters for frames A and B)
-    int angleIndex = 0;
-    bool mirror = false;
-
-    if (frameHasAngles[p.frameIndex]) {
-      float spriteAngle = p.angle - angleToProj + M_PI;
-      while (spriteAngle < 0)
-        spriteAngle += 2 * M_PI;
-      while (spriteAngle >= 2 * M_PI)
-        spriteAngle -= 2 * M_PI;
-
-      angleIndex = int(((spriteAngle / (2 * M_PI)) * 8) + 0.5) & 7;
-      mirror = shouldMirror[angleIndex];
-    }
-
-    Sprite &sprite = projectileSprites[p.frameIndex][angleIndex];
-
-    float corrected = dist * cosf(relAngle);
-    if (corrected < 0.1f)
-      corrected = 0.1f;
-
-    int spriteH = int((float(h) / corrected) * 0.6f); // Smaller than enemies
-    int spriteW =
-        int((float(sprite.width) / float(sprite.height)) * float(spriteH));
-    // Instead of floorLine calculation
-    float projHeight =
-        (0.5f + PROJECTILE_HEIGHT_OFFSET); // fractional vertical offset
-    int drawY = int((h / 2) - (spriteH * projHeight));
-    int drawX = int((0.5f + relAngle / FOV) * w - spriteW / 2);
-
-    if (zBuffer) {
-      drawSpriteScaledWithDepth(&sprite, drawX, drawY,
-                                float(spriteW) / sprite.width, mirror, pixels,
-                                w, h, zBuffer, corrected);
-    } else {
-      drawSpriteScaled(&sprite, drawX, drawY, float(spriteW) / sprite.width,
-                       mirror, pixels, w, h);
-    }
+    Billboard b;
+    b.x = p.x;
+    b.y = p.y;
+    b.facingX = p.vx;
+    b.facingY = p.vy;
+    // Only frames A and B look different from each side
+    b.views = projectileSprites[p.frameIndex];
+    b.viewCount = frameHasAngles[p.frameIndex] ? 8 : 1;
+    b.mirror = shouldMirror;
+    b.sizeViews = b.views;
+    b.height = PROJECTILE_SIZE; // Smaller than enemies
+    // Its middle sits PROJECTILE_HEIGHT_OFFSET of its height above eye
+    // level
+    b.bottom = (0.5f - PROJECTILE_HEIGHT_OFFSET) * PROJECTILE_SIZE;
+    b.depthBias = 0.0f;
+    b.id = -1;
+    addBillboard(b);
   }
 }
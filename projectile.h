@@ -30,8 +30,8 @@ bool loadProjectileSprites();
 void cleanupProjectileSprites();
 void initProjectiles();
 void updateProjectiles(float deltaTime);
-void renderProjectiles(uint32_t *pixels, int screenWidth, int screenHeight,
-                       float *zBuffer);
+// Adds this frame's projectiles to the billboard list
+void addProjectileBillboards();
 
 // Spawning
 void spawnEnemyProjectile(float x, float y, float targetX, float targetY);
@@ -0,0 +1,263 @@
+#include "raycast.h"
+#include "map.h"
+#include "player.h"
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+// Where a ray is in its walk through the grid
+struct RayState {
+  int mapX, mapY;
+  int stepX, stepY; // +1 or -1
+  float sideDistX, sideDistY;
+  float deltaDistX, deltaDistY;
+  bool vertical;
+};
+
+static inline void startRay(RayState &ray, float originX, float originY,
+                            float dirX, float dirY) {
+  // Starting position
+  ray.mapX = (int)originX;
+  ray.mapY = (int)originY;
+
+  // Length of ray from one side to next in map
+  ray.deltaDistX = fabs(1.0f / dirX);
+  ray.deltaDistY = fabs(1.0f / dirY);
+
+  // Direction to step in (+1 or -1)
+  ray.stepX = dirX > 0 ? 1 : -1;
+  ray.stepY = dirY > 0 ? 1 : -1;
+
+  // Initial side distances
+  ray.sideDistX = (dirX > 0) ? (ray.mapX + 1.0f - originX) * ray.deltaDistX
+                             : (originX - ray.mapX) * ray.deltaDistX;
+
+  ray.sideDistY = (dirY > 0) ? (ray.mapY + 1.0f - originY) * ray.deltaDistY
+                             : (originY - ray.mapY) * ray.deltaDistY;
+
+  ray.vertical = false;
+}
+
+static inline bool insideMap(int x, int y) {
+  return x >= 0 && x < occupancy.width && y >= 0 && y < occupancy.height;
+}
+
+// Jumps the ray across the empty square around its cell: every cell within
+// `radius` of it in x and y is known to be open, so the ray can take up to
+// `radius` steps along each axis without looking at the grid. Works out
+// which axis uses up its steps first and how many steps the other axis
+// takes before that, which is where the DDA loop would have been.
+// invDeltaX and invDeltaY are 1 / deltaDistX and 1 / deltaDistY.
+static inline void skipEmptySpace(RayState &ray, int radius, float invDeltaX,
+                                  float invDeltaY) {
+  // Distance of the radius-th crossing on each axis
+  float lastX = ray.sideDistX + (radius - 1) * ray.deltaDistX;
+  float lastY = ray.sideDistY + (radius - 1) * ray.deltaDistY;
+
+  int stepsX, stepsY;
+  if (lastX < lastY) {
+    // Y crossings at or before lastX come first (the loop steps y on ties)
+    stepsX = radius;
+    stepsY = lastX >= ray.sideDistY
+                 ? (int)((lastX - ray.sideDistY) * invDeltaY) + 1
+                 : 0;
+    if (stepsY > radius)
+      stepsY = radius;
+  } else {
+    stepsY = radius;
+    stepsX = lastY > ray.sideDistX
+                 ? (int)((lastY - ray.sideDistX) * invDeltaX) + 1
+                 : 0;
+    if (stepsX > radius)
+      stepsX = radius;
+  }
+
+  // Skip the multiply for an axis that doesn't move: a ray parallel to it
+  // has an infinite delta, and 0 * inf is NaN
+  ray.mapX += stepsX * ray.stepX;
+  ray.mapY += stepsY * ray.stepY;
+  if (stepsX)
+    ray.sideDistX += stepsX * ray.deltaDistX;
+  if (stepsY)
+    ray.sideDistY += stepsY * ray.deltaDistY;
+}
+
+// Below this many free cells a jump costs more than the steps it saves
+#define MIN_SKIP_RADIUS 2
+
+// DDA algorithm: steps until the ray hits a wall. Leaving the map means
+// stepping onto the occupancy grid's solid border, so that stops it too.
+// With `skip` it jumps across open space using the wall distance field.
+template <bool skip> static inline void traverseRay(RayState &ray) {
+  if (!insideMap(ray.mapX, ray.mapY))
+    return;
+
+  float invDeltaX = skip ? 1.0f / ray.deltaDistX : 0.0f;
+  float invDeltaY = skip ? 1.0f / ray.deltaDistY : 0.0f;
+  do {
+    if (skip) {
+      int radius = wallDistance(ray.mapY, ray.mapX) - 1;
+      if (radius >= MIN_SKIP_RADIUS)
+        skipEmptySpace(ray, radius, invDeltaX, invDeltaY);
+    }
+
+    // Jump to next map square
+    if (ray.sideDistX < ray.sideDistY) {
+      ray.sideDistX += ray.deltaDistX;
+      ray.mapX += ray.stepX;
+      ray.vertical = true;
+    } else {
+      ray.sideDistY += ray.deltaDistY;
+      ray.mapY += ray.stepY;
+      ray.vertical = false;
+    }
+  } while (!isSolid(ray.mapY, ray.mapX));
+}
+
+static inline RayHit finishRay(const RayState &ray, float originX,
+                               float originY, float dirX, float dirY) {
+  RayHit hit;
+
+  // Calculate distance
+  float distance;
+  if (ray.vertical) {
+    distance = (ray.mapX - originX + (1 - ray.stepX) / 2) / dirX;
+  } else {
+    distance = (ray.mapY - originY + (1 - ray.stepY) / 2) / dirY;
+  }
+
+  hit.distance = distance;
+  hit.hitX = originX + dirX * distance;
+  hit.hitY = originY + dirY * distance;
+  hit.vertical = ray.vertical;
+
+  return hit;
+}
+
+static SpaceSkipping skipMode = SPACE_SKIP_AUTO;
+
+void setSpaceSkipping(SpaceSkipping mode) { skipMode = mode; }
+
+bool spaceSkippingActive() {
+  if (skipMode == SPACE_SKIP_AUTO)
+    return occupancy.width >= SPACE_SKIP_MIN_SIZE &&
+           occupancy.height >= SPACE_SKIP_MIN_SIZE;
+  return skipMode == SPACE_SKIP_ON;
+}
+
+RayHit castRayFrom(float originX, float originY, float dirX, float dirY) {
+  RayState ray;
+  startRay(ray, originX, originY, dirX, dirY);
+  if (spaceSkippingActive())
+    traverseRay<true>(ray);
+  else
+    traverseRay<false>(ray);
+  return finishRay(ray, originX, originY, dirX, dirY);
+}
+
+// DDA Raycasting - much faster and more accurate
+//
+// The direction doesn't need to be normalised. The returned distance is
+// measured along the direction vector, so for a camera ray (dir + plane * k)
+// it is the perpendicular distance to the camera plane - no fisheye fix-up
+// needed - and for a unit vector it is the Euclidean distance.
+RayHit castRayDDA(float dirX, float dirY) {
+  return castRayFrom(playerX, playerY, dirX, dirY);
+}
+
+RayHit castRayDDA(float angle) {
+  return castRayDDA(cosf(angle), sinf(angle));
+}
+
+void castRays(const float *dirX, const float *dirY, int count, RayHit *hits) {
+  for (int i = 0; i < count; i++)
+    hits[i] = castRayDDA(dirX[i], dirY[i]);
+}
+
+// One bit per cell of the square window around the player, in rows of
+// `stride` words. Workers only ever set bits, and a cell is usually crossed
+// by many rays, so they look before writing and only the first ray to reach
+// a cell pays for the atomic OR.
+struct VisibleCells {
+  bool valid = false; // cleared at least once
+  int left = 0, top = 0; // map cell at the window's corner
+  int size = 0;          // cells along each side
+  int stride = 0;
+  std::vector<std::atomic<uint32_t>> bits;
+};
+
+static VisibleCells visible;
+
+static inline bool insideWindow(int x, int y) {
+  return (unsigned)(x - visible.left) < (unsigned)visible.size &&
+         (unsigned)(y - visible.top) < (unsigned)visible.size;
+}
+
+void clearVisibleCells(int range) {
+  int size = 2 * range + 1;
+  if (visible.size != size) {
+    visible.size = size;
+    visible.stride = (size + 31) / 32;
+    visible.bits =
+        std::vector<std::atomic<uint32_t>>((size_t)visible.stride * size);
+  } else {
+    for (std::atomic<uint32_t> &word : visible.bits)
+      word.store(0, std::memory_order_relaxed);
+  }
+
+  visible.valid = true;
+  visible.left = (int)playerX - range;
+  visible.top = (int)playerY - range;
+}
+
+void markVisibleCells(const float *dirX, const float *dirY,
+                      const RayHit *hits, int count) {
+  for (int i = 0; i < count; i++) {
+    // The same walk as traverseRay, stopping at the boundary it hit. The
+    // window is a square around the start, so once a ray leaves it it
+    // never comes back.
+    RayState ray;
+    startRay(ray, playerX, playerY, dirX[i], dirY[i]);
+    float distance = hits[i].distance;
+    while (insideWindow(ray.mapX, ray.mapY)) {
+      int x = ray.mapX - visible.left;
+      int y = ray.mapY - visible.top;
+      std::atomic<uint32_t> &word = visible.bits[y * visible.stride + (x >> 5)];
+      uint32_t bit = 1u << (x & 31);
+      if (!(word.load(std::memory_order_relaxed) & bit))
+        word.fetch_or(bit, std::memory_order_relaxed);
+
+      if (ray.sideDistX < ray.sideDistY) {
+        if (ray.sideDistX >= distance)
+          break;
+        ray.sideDistX += ray.deltaDistX;
+        ray.mapX += ray.stepX;
+      } else {
+        if (ray.sideDistY >= distance)
+          break;
+        ray.sideDistY += ray.deltaDistY;
+        ray.mapY += ray.stepY;
+      }
+    }
+  }
+}
+
+bool cellVisible(int x, int y) {
+  if (!visible.valid || !insideWindow(x, y))
+    return true;
+  x -= visible.left;
+  y -= visible.top;
+  uint32_t word = visible.bits[y * visible.stride + (x >> 5)].load(
+      std::memory_order_relaxed);
+  return (word >> (x & 31)) & 1;
+}
+
+bool areaVisible(float x, float y, float radius) {
+  int x0 = (int)floorf(x - radius), x1 = (int)floorf(x + radius);
+  int y0 = (int)floorf(y - radius), y1 = (int)floorf(y + radius);
+  for (int cy = y0; cy <= y1; cy++)
+    for (int cx = x0; cx <= x1; cx++)
+      if (cellVisible(cx, cy))
+        return true;
+  return false;
+}
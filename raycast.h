@@ -0,0 +1,52 @@
+#pragma once
+
+struct RayHit {
+  float distance;
+  float hitX;
+  float hitY;
+  bool vertical; // hit vertical wall or horizontal wall
+};
+
+// Casts a ray from the player. The distance is measured in units of the
+// direction vector: perpendicular for camera rays, Euclidean for angles.
+RayHit castRayDDA(float angle);
+RayHit castRayDDA(float dirX, float dirY);
+// Same walk from any point, for line of sight and hitscan
+RayHit castRayFrom(float originX, float originY, float dirX, float dirY);
+
+// Empty-space skipping: in open areas rays jump straight across the empty
+// square around their cell (see wallDistance in map.h) instead of stepping
+// through it one cell at a time. It pays off on big open maps; on small,
+// dense ones there is nothing to skip, so by default it only turns on for
+// maps at least SPACE_SKIP_MIN_SIZE cells across. Jumps land where stepping
+// would have, but the side distances are summed in a different order, so
+// hits can differ from the stepping walk in the last bit.
+#define SPACE_SKIP_MIN_SIZE 64
+enum SpaceSkipping { SPACE_SKIP_AUTO, SPACE_SKIP_ON, SPACE_SKIP_OFF };
+
+void setSpaceSkipping(SpaceSkipping mode);
+bool spaceSkippingActive();
+
+// hits[i] = castRayDDA(dirX[i], dirY[i]) for every i in [0, count)
+void castRays(const float *dirX, const float *dirY, int count, RayHit *hits);
+
+// Visible cells: the cells camera rays crossed on their way to the walls
+// they hit, one bit per cell. Anything standing in a cell no ray crossed is
+// behind a wall or outside the view, so entities can be dropped before any
+// projection. render3DView clears the set and marks every column's ray once
+// it has been cast, walking it again up to its hit; the walk reads no map,
+// so it also covers the cells space skipping jumped over.
+//
+// Only a window reaching `range` cells either side of the player is
+// tracked, which keeps long rays across open maps from having to be walked
+// to the end. Cells outside it always count as visible, as does every cell
+// before the first clearVisibleCells.
+void clearVisibleCells(int range);
+// Marks the cells each of the rays crossed before hits[i]. Safe to call
+// from several threads at once.
+void markVisibleCells(const float *dirX, const float *dirY,
+                      const RayHit *hits, int count);
+bool cellVisible(int x, int y);
+// True if any cell the square reaching `radius` out from (x, y) touches
+// is visible
+bool areaVisible(float x, float y, float radius);
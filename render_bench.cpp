@@ -0,0 +1,1043 @@
+// render_bench.cpp - Headless renderer benchmark. Renders into a plain
+// buffer (no SDL window) while replaying a scripted camera path through the
+// level with live enemies and projectiles, and reports ms/frame percentiles
+// per render stage.
+//
+// --scaling measures how render3DView scales with render threads,
+// --shading compares the light tables against the old float shading,
+// --texture-layout times wall slice sampling in both texture layouts and
+// --wall-kernels checks and times the SIMD wall kernels and --present
+// measures drawing straight into the output texture against the old
+// clear, draw and copy, --pipeline compares presenting on the render
+// thread against handing frames to a separate present stage,
+// --open-arena times empty-space skipping on big open maps,
+// --streaming walks across a streamed 4096x4096 map, --point-blank
+// times drawing an enemy from further off down to point-blank range and
+// --sprite-kernels checks and times the SIMD sprite kernels. --wall-rows
+// checks walls start on texel row 0 and exits non-zero if not; ctest runs
+// it at odd render heights.
+// Run from the project root so the sprites/ directory can be found.
+#include "billboard.h"
+#include "enemy.h"
+#include "gun.h"
+#include "map.h"
+#include "pipeline.h"
+#include "player.h"
+#include "projectile.h"
+#include "renderer.h"
+#include "texture.h"
+#include "threadpool.h"
+#include "wallslice.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+struct Resolution {
+  int width;
+  int height;
+};
+
+static const Resolution defaultResolutions[] = {
+    {620, 400}, {1280, 720}, {1920, 1080}, {2560, 1440}, {3840, 2160}};
+
+typedef std::chrono::steady_clock Clock;
+
+static double msSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+//
+// CAMERA PATH
+//
+// A loop through every room of the stock level: out of the start room,
+// across the main hall, down through the south-east room and back along
+// the south side. The camera looks along the path and sways left and right
+// so walls are seen at every angle.
+struct Waypoint {
+  float x, y;
+};
+
+static const Waypoint cameraPath[] = {
+    {2.5f, 2.5f},   {4.5f, 4.5f},  {4.5f, 8.0f},   {9.5f, 8.5f},
+    {15.5f, 9.5f},  {15.5f, 14.5f}, {15.5f, 16.5f}, {9.5f, 16.5f},
+    {4.5f, 16.5f},  {4.5f, 12.0f}, {2.5f, 9.5f},   {2.5f, 2.5f}};
+static const int cameraPathPoints = sizeof(cameraPath) / sizeof(cameraPath[0]);
+
+// Puts the player at position t (0..1) along the path
+static void placeCamera(float t) {
+  float total = 0.0f;
+  for (int i = 0; i + 1 < cameraPathPoints; i++)
+    total += hypotf(cameraPath[i + 1].x - cameraPath[i].x,
+                    cameraPath[i + 1].y - cameraPath[i].y);
+
+  float along = t * total;
+  for (int i = 0; i + 1 < cameraPathPoints; i++) {
+    const Waypoint &a = cameraPath[i];
+    const Waypoint &b = cameraPath[i + 1];
+    float length = hypotf(b.x - a.x, b.y - a.y);
+
+    if (along <= length || i + 2 == cameraPathPoints) {
+      float f = length > 0.0f ? std::min(along / length, 1.0f) : 0.0f;
+      playerX = a.x + (b.x - a.x) * f;
+      playerY = a.y + (b.y - a.y) * f;
+      playerAngle = atan2f(b.y - a.y, b.x - a.x) +
+                    0.6f * sinf(t * 2.0f * (float)M_PI * 6.0f);
+      return;
+    }
+    along -= length;
+  }
+}
+
+//
+// PER-STAGE TIMINGS
+//
+enum Stage {
+  STAGE_SIMULATE,
+  STAGE_VIEW,
+  STAGE_BILLBOARDS,
+  STAGE_GUN,
+  STAGE_TOTAL,
+  STAGE_COUNT
+};
+
+static const char *stageNames[STAGE_COUNT] = {
+    "simulate", "render3DView", "billboards", "drawGun", "frame total"};
+
+// Draws the enemies, corpses and projectiles the way the game does
+static void renderBillboards(RenderContext *ctx) {
+  beginBillboards();
+  addEnemyBillboards();
+  addProjectileBillboards();
+  drawBillboards(ctx);
+}
+
+static double percentile(std::vector<double> &samples, double p) {
+  if (samples.empty())
+    return 0.0;
+  std::sort(samples.begin(), samples.end());
+  size_t i = (size_t)(p / 100.0 * (samples.size() - 1) + 0.5);
+  return samples[i];
+}
+
+// Replays the camera path once at the given resolution. The world is
+// simulated at a fixed 60 Hz step so every run sees the same frames.
+static void runCameraPath(int width, int height, int frames) {
+  RenderContext ctx;
+  if (!createRenderContext(&ctx, width, height))
+    return;
+  std::vector<double> samples[STAGE_COUNT];
+  for (std::vector<double> &s : samples)
+    s.reserve(frames);
+
+  srand(1);
+  initEnemies();
+  initProjectiles();
+
+  long hidden = 0, added = 0, culled = 0;
+  const float dt = 1.0f / 60.0f;
+  for (int f = 0; f < frames; f++) {
+    Clock::time_point frameStart = Clock::now();
+
+    Clock::time_point t = Clock::now();
+    placeCamera((float)f / frames);
+    updateGun(dt);
+    updateEnemies(dt);
+    updateProjectiles(dt);
+    checkProjectilePlayerHit(playerX, playerY, 0.3f);
+    samples[STAGE_SIMULATE].push_back(msSince(t));
+
+    t = Clock::now();
+    render3DView(&ctx);
+    samples[STAGE_VIEW].push_back(msSince(t));
+
+    t = Clock::now();
+    renderBillboards(&ctx);
+    samples[STAGE_BILLBOARDS].push_back(msSince(t));
+    BillboardStats stats = getBillboardStats();
+    hidden += stats.hidden;
+    added += stats.added;
+    culled += stats.culled;
+
+    t = Clock::now();
+    drawGun(&ctx);
+    samples[STAGE_GUN].push_back(msSince(t));
+
+    samples[STAGE_TOTAL].push_back(msSince(frameStart));
+  }
+
+  printf("\n%dx%d, %d frames, %d threads\n", width, height, frames,
+         getThreadPoolSize());
+  printf("stage                  p50      p90      p99      max   (ms)\n");
+  for (int i = 0; i < STAGE_COUNT; i++) {
+    printf("%-18s %8.3f %8.3f %8.3f %8.3f\n", stageNames[i],
+           percentile(samples[i], 50), percentile(samples[i], 90),
+           percentile(samples[i], 99), percentile(samples[i], 100));
+  }
+  printf("billboards per frame: %.1f hidden, %.1f added, %.1f culled\n",
+         (double)hidden / frames, (double)added / frames,
+         (double)culled / frames);
+
+  destroyRenderContext(&ctx);
+}
+
+// Renders `frames` frames while turning on the spot and returns ms/frame
+static double timeRender(RenderContext *ctx, int frames) {
+  playerX = 10.0f;
+  playerY = 8.5f;
+
+  // One untimed frame to warm up caches and wake the workers
+  playerAngle = 0.0f;
+  render3DView(ctx);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int f = 0; f < frames; f++) {
+    playerAngle = 2.0f * M_PI * f / frames;
+    render3DView(ctx);
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double, std::milli>(end - start).count() /
+         frames;
+}
+
+// Renders the same view with the light tables and with the old float
+// shading and reports how far apart the two images are
+static void compareShading(int width, int height, int frames) {
+  RenderContext tables, reference;
+  if (!createRenderContext(&tables, width, height) ||
+      !createRenderContext(&reference, width, height))
+    return;
+
+  setShadingMode(SHADING_COLORMAP);
+  double tableMs = timeRender(&tables, frames);
+  setShadingMode(SHADING_FLOAT);
+  double floatMs = timeRender(&reference, frames);
+  setShadingMode(SHADING_COLORMAP);
+
+  // timeRender leaves both buffers holding its last frame
+  int maxDiff = 0;
+  long long totalDiff = 0;
+  long long differing = 0;
+  long long pixelCount = (long long)width * height;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      uint32_t t = tables.pixels[y * tables.pitch + x];
+      uint32_t r = reference.pixels[y * reference.pitch + x];
+      bool differs = false;
+      for (int shift = 0; shift < 24; shift += 8) {
+        int a = (t >> shift) & 0xFF;
+        int b = (r >> shift) & 0xFF;
+        int diff = a > b ? a - b : b - a;
+        totalDiff += diff;
+        maxDiff = diff > maxDiff ? diff : maxDiff;
+        differs |= diff != 0;
+      }
+      differing += differs;
+    }
+  }
+
+  printf("%dx%d: tables %.3f ms, float %.3f ms (%.2fx)\n", width, height,
+         tableMs, floatMs, floatMs / tableMs);
+  printf("  max channel diff %d, mean %.3f, %.1f%% of pixels differ\n",
+         maxDiff, (double)totalDiff / (pixelCount * 3),
+         100.0 * differing / pixelCount);
+
+  destroyRenderContext(&tables);
+  destroyRenderContext(&reference);
+}
+
+// True if two same-sized contexts hold the same image
+static bool sameFrame(const RenderContext *a, const RenderContext *b) {
+  for (int y = 0; y < a->height; y++) {
+    if (memcmp(a->pixels + y * a->pitch, b->pixels + y * b->pitch,
+               a->width * sizeof(uint32_t)))
+      return false;
+  }
+  return true;
+}
+
+// Samples vertical wall slices the way render3DView does and returns
+// nanoseconds per texel. Neighbouring screen columns land on scattered
+// texture columns, like a distant or angled wall.
+static double timeWallSlices(const Texture *tex, int sliceHeight,
+                             int columns) {
+  volatile uint32_t sink = 0;
+  uint32_t sum = 0;
+  int texStep = (tex->height << 16) / sliceHeight;
+  int texStride = columnStride(tex);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int c = 0; c < columns; c++) {
+    int texX = (c * 37) % tex->width;
+    const uint32_t *texColumn = texelAddress(tex, texX, 0);
+    int texPos = 0;
+    for (int y = 0; y < sliceHeight; y++, texPos += texStep)
+      sum += texColumn[((texPos >> 16) & tex->heightMask) * texStride];
+  }
+  auto end = std::chrono::steady_clock::now();
+  sink = sum;
+  (void)sink;
+
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         ((double)columns * sliceHeight);
+}
+
+static void compareTextureLayouts() {
+  const int sizes[] = {64, 256, 1024};
+  const int sliceHeights[] = {100, 400, 1080};
+  const int columns = 20000;
+
+  printf("texture   slice   row-major   column-major   (ns/texel)\n");
+  for (int size : sizes) {
+    std::vector<uint32_t> argb(size * size);
+    for (size_t i = 0; i < argb.size(); i++)
+      argb[i] = 0xFF000000u | (uint32_t)(i * 2654435761u >> 8);
+
+    Texture rowMajor, columnMajor;
+    createTexture(&rowMajor, argb.data(), size, size, TEXTURE_ROW_MAJOR);
+    createTexture(&columnMajor, argb.data(), size, size, TEXTURE_COLUMN_MAJOR);
+
+    // Untimed pass so neither layout pays for first-touch page faults
+    timeWallSlices(&rowMajor, size, columns / 10);
+    timeWallSlices(&columnMajor, size, columns / 10);
+
+    for (int h : sliceHeights) {
+      double rowNs = timeWallSlices(&rowMajor, h, columns);
+      double colNs = timeWallSlices(&columnMajor, h, columns);
+      printf("%4dx%-4d %5d   %9.3f   %12.3f   %.2fx\n", size, size, h, rowNs,
+             colNs, rowNs / colNs);
+    }
+
+    freeTexture(&rowMajor);
+    freeTexture(&columnMajor);
+  }
+}
+
+// Times every wall kernel this CPU supports and checks each one renders
+// exactly the same pixels as the scalar kernel
+static void compareWallKernels(int width, int height, int frames) {
+  const WallKernel kernels[] = {WALL_KERNEL_SCALAR, WALL_KERNEL_SSE4,
+                                WALL_KERNEL_AVX2};
+  RenderContext reference, ctx;
+  if (!createRenderContext(&reference, width, height) ||
+      !createRenderContext(&ctx, width, height))
+    return;
+
+  printf("%dx%d\n", width, height);
+  double scalarMs = 0.0;
+  for (WallKernel kernel : kernels) {
+    if (!setWallKernel(kernel)) {
+      printf("  %-7s not supported\n", wallKernelName(kernel));
+      continue;
+    }
+
+    // Same spots as timeRender, a few angles at a time
+    int mismatches = 0;
+    for (int f = 0; f < 36; f++) {
+      playerAngle = 2.0f * M_PI * f / 36;
+      setWallKernel(WALL_KERNEL_SCALAR);
+      render3DView(&reference);
+      setWallKernel(kernel);
+      render3DView(&ctx);
+      mismatches += !sameFrame(&ctx, &reference);
+    }
+    setRenderTarget(&ctx, nullptr, 0);
+
+    double ms = timeRender(&ctx, frames);
+    if (kernel == WALL_KERNEL_SCALAR)
+      scalarMs = ms;
+
+    printf("  %-7s %8.3f ms/frame  %.2fx  %s\n", wallKernelName(kernel), ms,
+           scalarMs / ms, mismatches ? "MISMATCH" : "bit-identical");
+  }
+
+  setWallKernel(bestWallKernel());
+  destroyRenderContext(&reference);
+  destroyRenderContext(&ctx);
+}
+
+// Checks that every wall starts on texel row 0. With an odd render height a
+// wall of even height starts half a pixel above its texture, and that row
+// used to wrap round to the bottom row, leaving a one-pixel seam along the
+// top of the wall. The check uses a texture with a red top half and a blue
+// bottom half and looks at the top pixel of every wall drawn tall enough
+// that its mip level still keeps the halves apart.
+static bool checkWallRows(int width, int height, int frames) {
+  const int size = 64;
+  std::vector<uint32_t> texels(size * size);
+  for (int y = 0; y < size; y++)
+    for (int x = 0; x < size; x++)
+      texels[y * size + x] = y < size / 2 ? 0xFFFF0000 : 0xFF0000FF;
+
+  RenderContext ctx;
+  if (!createWallTexture(texels.data(), size, size) ||
+      !createRenderContext(&ctx, width, height))
+    return false;
+
+  const ShadingMode modes[] = {SHADING_COLORMAP, SHADING_FLOAT};
+  long checked = 0, seams = 0;
+  for (ShadingMode mode : modes) {
+    setShadingMode(mode);
+    for (int f = 0; f < frames; f++) {
+      placeCamera((float)f / frames);
+      render3DView(&ctx);
+      for (int x = 0; x < width; x++) {
+        int top = ctx.wallTop[x];
+        if (top == 0 || ctx.wallBottom[x] - top < size / 2)
+          continue;
+        uint32_t pixel = ctx.pixels[top * ctx.pitch + x];
+        checked++;
+        seams += (pixel & 0xFF) > ((pixel >> 16) & 0xFF);
+      }
+    }
+  }
+  setShadingMode(SHADING_COLORMAP);
+
+  printf("%dx%d: %ld wall tops checked, %ld start on the bottom row: %s\n",
+         width, height, checked, seams, seams ? "FAILED" : "ok");
+  destroyRenderContext(&ctx);
+  return loadWallTexture("sprites/wall.png") && checked > 0 && seams == 0;
+}
+
+// The game used to clear its own framebuffer, draw into it and copy it into
+// the SDL texture; now it draws straight into the locked texture. A plain
+// buffer stands in for the texture memory here.
+static void comparePresent(int width, int height, int frames) {
+  RenderContext ctx;
+  if (!createRenderContext(&ctx, width, height))
+    return;
+  std::vector<uint32_t> texture((size_t)width * height);
+  std::vector<uint32_t> copied((size_t)width * height);
+
+  playerX = 10.0f;
+  playerY = 8.5f;
+  double copyMs = 0.0;
+  double directMs = 0.0;
+  int mismatches = 0;
+  for (int f = -1; f < frames; f++) { // frame -1 is an untimed warm-up
+    playerAngle = 2.0f * M_PI * (f < 0 ? 0 : f) / frames;
+
+    Clock::time_point t = Clock::now();
+    setRenderTarget(&ctx, nullptr, 0);
+    memset(ctx.pixels, 0, (size_t)ctx.pitch * height * sizeof(uint32_t));
+    render3DView(&ctx);
+    for (int y = 0; y < height; y++)
+      memcpy(&copied[(size_t)y * width], ctx.pixels + y * ctx.pitch,
+             width * sizeof(uint32_t));
+    double ms = msSince(t);
+    if (f >= 0)
+      copyMs += ms;
+
+    t = Clock::now();
+    setRenderTarget(&ctx, texture.data(), width);
+    render3DView(&ctx);
+    ms = msSince(t);
+    if (f >= 0)
+      directMs += ms;
+
+    mismatches += texture != copied;
+  }
+  destroyRenderContext(&ctx);
+
+  copyMs /= frames;
+  directMs /= frames;
+  printf("%dx%d: clear+copy %.3f ms, direct %.3f ms, saves %.3f ms/frame "
+         "(%.1f%%)%s\n",
+         width, height, copyMs, directMs, copyMs - directMs,
+         100.0 * (copyMs - directMs) / copyMs,
+         mismatches ? "  MISMATCH" : "");
+}
+
+// Stand-in for SDL_RenderCopy + SDL_RenderPresent: uploads the frame and
+// then blocks the way a driver waiting on vsync does
+static const int PRESENT_MS = 6;
+
+struct PipelineBench {
+  RenderContext buffers[2];
+  std::vector<uint32_t> screen;
+  int frame;
+  int frames;
+};
+
+static void pipelineFrameJob(void *userData, int buffer) {
+  PipelineBench &bench = *(PipelineBench *)userData;
+  RenderContext *ctx = &bench.buffers[buffer];
+
+  const float dt = 1.0f / 60.0f;
+  placeCamera((float)bench.frame++ / bench.frames);
+  updateGun(dt);
+  updateEnemies(dt);
+  updateProjectiles(dt);
+  render3DView(ctx);
+  renderBillboards(ctx);
+  drawGun(ctx);
+}
+
+static void fakePresent(PipelineBench &bench, int buffer) {
+  const RenderContext &ctx = bench.buffers[buffer];
+  for (int y = 0; y < ctx.height; y++)
+    memcpy(&bench.screen[(size_t)y * ctx.width], ctx.pixels + y * ctx.pitch,
+           ctx.width * sizeof(uint32_t));
+  std::this_thread::sleep_for(std::chrono::milliseconds(PRESENT_MS));
+}
+
+// Frame rate with presenting done after every frame on the same thread,
+// and with the frame pipeline overlapping it with the next frame
+static void comparePipeline(int width, int height, int frames) {
+  PipelineBench bench;
+  for (RenderContext &ctx : bench.buffers) {
+    if (!createRenderContext(&ctx, width, height))
+      return;
+  }
+  bench.screen.resize((size_t)width * height);
+  bench.frames = frames;
+
+  printf("%dx%d, %d ms present\n", width, height, PRESENT_MS);
+
+  srand(1);
+  initEnemies();
+  initProjectiles();
+  bench.frame = 0;
+  Clock::time_point t = Clock::now();
+  for (int f = 0; f < frames; f++) {
+    pipelineFrameJob(&bench, 0);
+    fakePresent(bench, 0);
+  }
+  double serialMs = msSince(t) / frames;
+  printf("  serial           %8.3f ms/frame\n", serialMs);
+
+  for (int bound = 0; bound < 2; bound++) {
+    srand(1);
+    initEnemies();
+    initProjectiles();
+    bench.frame = 0;
+    t = Clock::now();
+
+    startFramePipeline(bound, pipelineFrameJob, &bench);
+    queueFrameBuffer(0);
+    queueFrameBuffer(1);
+    for (int f = 0; f < frames; f++) {
+      int buffer = takeFinishedFrame(1000);
+      if (buffer < 0)
+        break;
+      fakePresent(bench, buffer);
+      if (f + 2 < frames) // the last two frames are already in flight
+        queueFrameBuffer(buffer);
+    }
+    stopFramePipeline();
+
+    double ms = msSince(t) / frames;
+    printf("  %-16s %8.3f ms/frame  %.2fx\n",
+           bound ? "bound latency" : "pipelined", ms, serialMs / ms);
+  }
+
+  for (RenderContext &ctx : bench.buffers)
+    destroyRenderContext(&ctx);
+}
+
+//
+// OPEN ARENAS
+//
+
+// Square arena of `size` cells: a solid border and 2x2 pillars every 64
+// cells, set a little off the grid so the rays don't line up with them
+static std::vector<uint8_t> buildArena(int size) {
+  std::vector<uint8_t> tiles((size_t)size * size, MAP_TILE_EMPTY);
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      bool border = x == 0 || y == 0 || x == size - 1 || y == size - 1;
+      int px = (x + 23 * (y / 64)) % 64;
+      int py = y % 64;
+      tiles[y * size + x] = border || (px >= 30 && px < 32 &&
+                                       py >= 30 && py < 32);
+    }
+  }
+  return tiles;
+}
+
+// Within a hundredth of a cell of a grid corner
+static bool nearCorner(const RayHit &hit) {
+  return fabsf(hit.hitX - roundf(hit.hitX)) < 0.01f &&
+         fabsf(hit.hitY - roundf(hit.hitY)) < 0.01f;
+}
+
+// Times the camera rays and line of sight checks on big open arenas with
+// plain stepping and with empty-space skipping
+static void compareOpenArena(int width, int frames) {
+  const int sizes[] = {256, 512, 1024};
+  const int losChecks = 4096;
+
+  std::vector<float> offset(width), rayX(width), rayY(width);
+  std::vector<RayHit> expect(width), hits(width);
+  float planeLength = tanf(FOV / 2.0f);
+  for (int x = 0; x < width; x++)
+    offset[x] = (2.0f * x / (float)width - 1.0f) * planeLength;
+
+  printf("%d rays per frame\n", width);
+  for (int size : sizes) {
+    std::vector<uint8_t> tiles = buildArena(size);
+    buildOccupancyGrid(size, size, tiles.data());
+
+    // Circle the middle of the arena, turning the camera all the way round
+    auto aimRays = [&](float t) {
+      float angle = t * 2.0f * (float)M_PI;
+      playerX = size * (0.5f + 0.2f * cosf(angle)) + 0.37f;
+      playerY = size * (0.5f + 0.2f * sinf(angle)) + 0.61f;
+      playerAngle = angle * 3.0f;
+      float dirX = cosf(playerAngle);
+      float dirY = sinf(playerAngle);
+      for (int x = 0; x < width; x++) {
+        rayX[x] = dirX - dirY * offset[x];
+        rayY[x] = dirY + dirX * offset[x];
+      }
+    };
+
+    // Stepping and skipping must find the same walls
+    int mismatches = 0, grazes = 0;
+    for (int f = 0; f < 60; f++) {
+      aimRays(f / 60.0f);
+      setSpaceSkipping(SPACE_SKIP_OFF);
+      castRays(rayX.data(), rayY.data(), width, expect.data());
+      setSpaceSkipping(SPACE_SKIP_ON);
+      castRays(rayX.data(), rayY.data(), width, hits.data());
+      for (int x = 0; x < width; x++) {
+        if (fabsf(expect[x].distance - hits[x].distance) <=
+                1e-3f * expect[x].distance &&
+            expect[x].vertical == hits[x].vertical)
+          continue;
+        // A ray that grazes the corner of a wall can go either way
+        if (nearCorner(expect[x]) || nearCorner(hits[x]))
+          grazes++;
+        else
+          mismatches++;
+      }
+    }
+
+    struct Mode {
+      const char *name;
+      SpaceSkipping skipping;
+    };
+    const Mode modes[] = {{"stepping", SPACE_SKIP_OFF},
+                          {"skipping", SPACE_SKIP_ON}};
+
+    printf("  %dx%d arena, %s (%d corner grazes)\n", size, size,
+           mismatches ? "MISMATCH" : "same hits", grazes);
+    double steppingRays = 0.0, steppingSight = 0.0;
+    for (const Mode &mode : modes) {
+      setSpaceSkipping(mode.skipping);
+
+      Clock::time_point t = Clock::now();
+      for (int f = 0; f < frames; f++) {
+        aimRays((float)f / frames);
+        castRays(rayX.data(), rayY.data(), width, hits.data());
+      }
+      double rayMs = msSince(t) / frames;
+
+      // Line of sight between random points, like an enemy checking on the
+      // player or a hitscan shot
+      srand(1);
+      volatile float sink = 0.0f;
+      t = Clock::now();
+      for (int i = 0; i < losChecks; i++) {
+        float x0 = 1.0f + (size - 2) * (rand() / (float)RAND_MAX);
+        float y0 = 1.0f + (size - 2) * (rand() / (float)RAND_MAX);
+        float angle = 2.0f * (float)M_PI * (rand() / (float)RAND_MAX);
+        sink += castRayFrom(x0, y0, cosf(angle), sinf(angle)).distance;
+      }
+      double sightUs = msSince(t) * 1000.0 / losChecks;
+
+      if (mode.skipping == SPACE_SKIP_OFF) {
+        steppingRays = rayMs;
+        steppingSight = sightUs;
+      }
+      printf("    %-8s rays %7.3f ms (%.2fx)  sight %6.3f us (%.2fx)\n",
+             mode.name, rayMs, steppingRays / rayMs, sightUs,
+             steppingSight / sightUs);
+    }
+  }
+
+  setSpaceSkipping(SPACE_SKIP_AUTO);
+  rebuildOccupancyGrid();
+}
+
+//
+// STREAMED MAPS
+//
+
+// Writes buildArena(size) out as a map file with the start in the west
+static bool writeArenaMap(const char *path, int size) {
+  std::vector<uint8_t> tiles = buildArena(size);
+
+  MapFileHeader header = {};
+  header.magic = MAP_FILE_MAGIC;
+  header.version = MAP_FILE_VERSION;
+  header.width = size;
+  header.height = size;
+  header.tileTypes = MAP_TILE_TYPES;
+  header.startX = 100.5f;
+  header.startY = size / 2 + 0.5f;
+  header.tilesOffset = sizeof(header);
+  header.spawnsOffset = (uint32_t)(sizeof(header) + tiles.size());
+
+  FILE *f = fopen(path, "wb");
+  bool ok = f && fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(tiles.data(), 1, tiles.size(), f) == tiles.size();
+  if (f)
+    ok = fclose(f) == 0 && ok;
+  if (!ok)
+    printf("ERROR: Could not write %s\n", path);
+  return ok;
+}
+
+// True if every chunk within MAX_DIST of the player is resident
+static bool viewResident() {
+  int x0 = std::max(0, (int)(playerX - MAX_DIST)) >> CHUNK_SHIFT;
+  int y0 = std::max(0, (int)(playerY - MAX_DIST)) >> CHUNK_SHIFT;
+  int x1 = std::min(level.width - 1, (int)(playerX + MAX_DIST)) >> CHUNK_SHIFT;
+  int y1 = std::min(level.height - 1, (int)(playerY + MAX_DIST)) >> CHUNK_SHIFT;
+  for (int cy = y0; cy <= y1; cy++) {
+    for (int cx = x0; cx <= x1; cx++) {
+      if (!chunkAt(cy << CHUNK_SHIFT, cx << CHUNK_SHIFT))
+        return false;
+    }
+  }
+  return true;
+}
+
+// Walks east across a 4096x4096 streamed map at several speeds and reports
+// the streaming cost per frame, how many chunks stay resident and how
+// often the loader fell behind the view
+static void compareStreaming(int width, int height, int frames) {
+  const int size = 4096;
+  const char *path = "/tmp/render_bench_stream.map";
+  const float speeds[] = {0.1f, 1.0f, 4.0f}; // cells per frame
+
+  RenderContext ctx;
+  if (!createRenderContext(&ctx, width, height))
+    return;
+  if (!writeArenaMap(path, size) || !loadMap(path)) {
+    destroyRenderContext(&ctx);
+    return;
+  }
+
+  printf("%dx%d, %dx%d map, at most %d chunks (%zu KB) resident\n", width,
+         height, size, size, maxResidentChunks(),
+         maxResidentChunks() * sizeof(TileChunk) / 1024);
+  printf("cells/frame   update ms (max)    frame ms   resident (max)   "
+         "behind\n");
+  for (float speed : speeds) {
+    playerX = level.startX;
+    playerY = level.startY;
+    updateMapStreaming(playerX, playerY);
+
+    double updateMs = 0.0, updateMax = 0.0, frameMs = 0.0;
+    int resident = 0, residentMax = 0, behind = 0;
+    for (int f = 0; f < frames; f++) {
+      playerX = level.startX + speed * f;
+      playerY = level.startY + 40.0f * sinf(f * 0.01f);
+      playerAngle = 0.8f * sinf(f * 0.05f);
+
+      Clock::time_point t = Clock::now();
+      updateMapStreaming(playerX, playerY);
+      double ms = msSince(t);
+      updateMs += ms;
+      updateMax = std::max(updateMax, ms);
+
+      resident += residentChunkCount();
+      residentMax = std::max(residentMax, residentChunkCount());
+      behind += !viewResident();
+
+      t = Clock::now();
+      render3DView(&ctx);
+      frameMs += msSince(t);
+    }
+
+    printf("%11.1f   %6.3f (%6.3f)   %8.3f   %8.1f (%3d)   %6d\n", speed,
+           updateMs / frames, updateMax, frameMs / frames,
+           (double)resident / frames, residentMax, behind);
+  }
+
+  unloadMap();
+  remove(path);
+  destroyRenderContext(&ctx);
+}
+
+//
+// POINT-BLANK SPRITES
+//
+
+// Looks east along the open row through the middle of the level and
+// returns an enemy facing the player; the rest stand behind the player's
+// back, out of view
+static Enemy &faceLoneEnemy(RenderContext *ctx) {
+  playerX = 1.5f;
+  playerY = 8.5f;
+  playerAngle = 0.0f;
+  render3DView(ctx);
+
+  initEnemies();
+  for (int i = 0; i < getEnemyCount(); i++) {
+    Enemy &e = getEnemy(i);
+    e.x = playerX - 0.5f;
+    e.y = playerY;
+    e.frameIndex = 0;
+  }
+  Enemy &enemy = getEnemy(0);
+  enemy.facingAngle = (float)M_PI;
+  return enemy;
+}
+
+// Walks an enemy up to the player, from across the hall to just short of
+// the nearest the billboard list draws, and times drawing it. Up close the
+// sprite is many times the size of the screen, so this is the worst case
+// for the sprite blitters.
+static void comparePointBlank(int width, int height, int frames) {
+  const float distances[] = {8.0f, 2.0f, 1.0f, 0.5f, 0.25f, 0.12f};
+
+  RenderContext ctx;
+  if (!createRenderContext(&ctx, width, height))
+    return;
+  Enemy &enemy = faceLoneEnemy(&ctx);
+
+  printf("\n%dx%d, %d frames\n", width, height, frames);
+  printf("distance   sprite height (px)   ms/draw\n");
+  for (float distance : distances) {
+    enemy.x = playerX + distance;
+    renderBillboards(&ctx);
+
+    Clock::time_point t = Clock::now();
+    for (int f = 0; f < frames; f++)
+      renderBillboards(&ctx);
+    double ms = msSince(t) / frames;
+
+    // Matches the sizing in addEnemyBillboards
+    int spriteHeight = (int)(height / std::max(distance, 0.1f) * 1.1f);
+    printf("%8.2f   %18d   %7.3f\n", distance, spriteHeight, ms);
+  }
+
+  destroyRenderContext(&ctx);
+}
+
+// Checks every sprite kernel draws exactly the same enemies as the scalar
+// kernel, from random spots, angles and frames, partly behind walls and
+// cut off by the screen edges, then times them from far off to point-blank.
+// Every other trial draws into an outside render target, which kernels may
+// only write.
+static void compareSpriteKernels(int width, int height, int frames) {
+  const SpriteKernel kernels[] = {SPRITE_KERNEL_SCALAR, SPRITE_KERNEL_SSE4,
+                                  SPRITE_KERNEL_AVX2};
+  const float distances[] = {8.0f, 2.0f, 0.5f, 0.12f};
+  const int distanceCount = sizeof(distances) / sizeof(distances[0]);
+  RenderContext reference, ctx;
+  if (!createRenderContext(&reference, width, height) ||
+      !createRenderContext(&ctx, width, height))
+    return;
+
+  printf("%dx%d            ms/draw at distance\n", width, height);
+  printf("kernel      ");
+  for (float distance : distances)
+    printf("%8.2f", distance);
+  printf("\n");
+
+  std::vector<uint32_t> target((size_t)width * height);
+  double scalarMs[distanceCount] = {};
+  for (SpriteKernel kernel : kernels) {
+    if (!setSpriteKernel(kernel)) {
+      printf("  %-7s   not supported\n", spriteKernelName(kernel));
+      continue;
+    }
+
+    int mismatches = 0;
+    srand(1);
+    initEnemies();
+    for (int trial = 0; trial < 200; trial++) {
+      placeCamera((float)rand() / RAND_MAX);
+      for (int i = 0; i < getEnemyCount(); i++) {
+        Enemy &e = getEnemy(i);
+        float angle = playerAngle + (rand() % 1000 / 1000.0f - 0.5f) * FOV;
+        float distance = 0.15f + rand() % 1000 / 1000.0f * 6.0f;
+        e.x = playerX + cosf(angle) * distance;
+        e.y = playerY + sinf(angle) * distance;
+        e.facingAngle = rand() % 1000 / 1000.0f * 2.0f * (float)M_PI;
+        e.frameIndex = rand() % ENEMY_TOTAL_FRAMES;
+      }
+      setRenderTarget(&ctx, trial % 2 ? target.data() : nullptr, width);
+      render3DView(&reference);
+      render3DView(&ctx);
+      setSpriteKernel(SPRITE_KERNEL_SCALAR);
+      renderBillboards(&reference);
+      setSpriteKernel(kernel);
+      renderBillboards(&ctx);
+      mismatches += !sameFrame(&ctx, &reference);
+    }
+    setRenderTarget(&ctx, nullptr, 0);
+
+    Enemy &enemy = faceLoneEnemy(&ctx);
+    printf("  %-7s   ", spriteKernelName(kernel));
+    double ms = 0.0;
+    for (int d = 0; d < distanceCount; d++) {
+      enemy.x = playerX + distances[d];
+      renderBillboards(&ctx);
+
+      Clock::time_point t = Clock::now();
+      for (int f = 0; f < frames; f++)
+        renderBillboards(&ctx);
+      ms = msSince(t) / frames;
+      if (kernel == SPRITE_KERNEL_SCALAR)
+        scalarMs[d] = ms;
+      printf("%8.3f", ms);
+    }
+    // Speedup at point-blank range
+    printf("   %.2fx  %s\n", scalarMs[distanceCount - 1] / ms,
+           mismatches ? "MISMATCH" : "bit-identical");
+  }
+
+  setSpriteKernel(bestSpriteKernel());
+  destroyRenderContext(&reference);
+  destroyRenderContext(&ctx);
+}
+
+static void printUsage() {
+  printf("Usage: render_bench [--threads N] [--frames N] [--res WxH]...\n"
+         "                    [--scaling | --shading | --texture-layout |\n"
+         "                     --wall-kernels | --present | --pipeline |\n"
+         "                     --open-arena | --streaming | --point-blank |\n"
+         "                     --sprite-kernels | --wall-rows]\n");
+}
+
+int main(int argc, char *argv[]) {
+  int threads = (int)std::thread::hardware_concurrency();
+  int frames = 600;
+  bool scaling = false;
+  bool shading = false;
+  bool wallKernels = false;
+  bool present = false;
+  bool pipeline = false;
+  bool openArena = false;
+  bool streaming = false;
+  bool pointBlank = false;
+  bool spriteKernels = false;
+  bool wallRows = false;
+  std::vector<Resolution> resolutions;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+      frames = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--res") && i + 1 < argc) {
+      Resolution r;
+      if (sscanf(argv[++i], "%dx%d", &r.width, &r.height) != 2 ||
+          r.width < 1 || r.height < 1) {
+        printf("Bad resolution '%s', expected WxH\n", argv[i]);
+        return 1;
+      }
+      resolutions.push_back(r);
+    } else if (!strcmp(argv[i], "--scaling")) {
+      scaling = true;
+    } else if (!strcmp(argv[i], "--shading")) {
+      shading = true;
+    } else if (!strcmp(argv[i], "--wall-kernels")) {
+      wallKernels = true;
+    } else if (!strcmp(argv[i], "--present")) {
+      present = true;
+    } else if (!strcmp(argv[i], "--pipeline")) {
+      pipeline = true;
+    } else if (!strcmp(argv[i], "--open-arena")) {
+      openArena = true;
+    } else if (!strcmp(argv[i], "--streaming")) {
+      streaming = true;
+    } else if (!strcmp(argv[i], "--point-blank")) {
+      pointBlank = true;
+    } else if (!strcmp(argv[i], "--sprite-kernels")) {
+      spriteKernels = true;
+    } else if (!strcmp(argv[i], "--wall-rows")) {
+      wallRows = true;
+    } else if (!strcmp(argv[i], "--texture-layout")) {
+      compareTextureLayouts();
+      return 0;
+    } else {
+      printUsage();
+      return 1;
+    }
+  }
+
+  if (threads < 1)
+    threads = 1;
+  if (frames < 1)
+    frames = 1;
+  if (resolutions.empty() && present)
+    resolutions = {{1920, 1080}, {3840, 2160}};
+  if (resolutions.empty())
+    resolutions.assign(std::begin(defaultResolutions),
+                       std::end(defaultResolutions));
+
+  if (!loadWallTexture("sprites/wall.png") ||
+      !loadCeilingTexture("sprites/GRAY.png") ||
+      !loadFloorTexture("sprites/Ceiling.png") || !loadGunSprites() ||
+      !loadEnemySprites() || !loadProjectileSprites()) {
+    printf("ERROR: Could not load sprites (run from the project root)\n");
+    return 1;
+  }
+
+  bool failed = false;
+  for (const Resolution &r : resolutions) {
+    if (scaling) {
+      RenderContext ctx;
+      if (!createRenderContext(&ctx, r.width, r.height))
+        return 1;
+
+      printf("\n%dx%d, %d frames\n", r.width, r.height, frames);
+      printf("threads   ms/frame   speedup   efficiency\n");
+
+      double baseline = 0.0;
+      for (int t = 1; t <= threads; t++) {
+        startThreadPool(t);
+        double ms = timeRender(&ctx, frames);
+        if (t == 1)
+          baseline = ms;
+
+        double speedup = baseline / ms;
+        printf("%7d   %8.3f   %6.2fx   %9.0f%%\n", t, ms, speedup,
+               100.0 * speedup / t);
+      }
+      destroyRenderContext(&ctx);
+      continue;
+    }
+
+    startThreadPool(threads);
+    if (shading)
+      compareShading(r.width, r.height, frames);
+    else if (wallKernels)
+      compareWallKernels(r.width, r.height, frames);
+    else if (present)
+      comparePresent(r.width, r.height, frames);
+    else if (pipeline)
+      comparePipeline(r.width, r.height, frames);
+    else if (openArena)
+      compareOpenArena(r.width, frames);
+    else if (streaming)
+      compareStreaming(r.width, r.height, frames);
+    else if (pointBlank)
+      comparePointBlank(r.width, r.height, frames);
+    else if (spriteKernels)
+      compareSpriteKernels(r.width, r.height, frames);
+    else if (wallRows)
+      failed |= !checkWallRows(r.width, r.height, frames);
+    else
+      runCameraPath(r.width, r.height, frames);
+  }
+
+  stopThreadPool();
+  cleanupWallTexture();
+  cleanupGunSprites();
+  cleanupEnemySprites();
+  cleanupProjectileSprites();
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,244 @@
+#include "rendercontext.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+static const size_t CACHE_LINE = 64;
+static const size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+static size_t alignUp(size_t n, size_t alignment) {
+  return (n + alignment - 1) / alignment * alignment;
+}
+
+static void *allocateBuffers(size_t size, bool hugePages, bool *mapped) {
+  *mapped = false;
+
+#ifdef __linux__
+  if (hugePages) {
+    void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      *mapped = true;
+      return p;
+    }
+
+    // No hugetlb pages reserved - ask for transparent huge pages instead
+    p = aligned_alloc(HUGE_PAGE, size);
+    if (p) {
+      madvise(p, size, MADV_HUGEPAGE);
+      return p;
+    }
+    // Neither worked - fall back to normal pages, as the header promises
+  }
+#else
+  (void)hugePages;
+#endif
+
+  return aligned_alloc(CACHE_LINE, size);
+}
+
+static void freeBuffers(RenderContext *ctx) {
+  if (!ctx->memory)
+    return;
+
+#ifdef __linux__
+  if (ctx->mappedHugePages)
+    munmap(ctx->memory, ctx->memorySize);
+  else
+    free(ctx->memory);
+#else
+  free(ctx->memory);
+#endif
+
+  ctx->memory = nullptr;
+  ctx->memorySize = 0;
+}
+
+bool createRenderContext(RenderContext *ctx, int width, int height,
+                         bool hugePages) {
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->hugePages = hugePages;
+  return resizeRenderContext(ctx, width, height);
+}
+
+bool resizeRenderContext(RenderContext *ctx, int width, int height) {
+  if (width <= 0 || height <= 0)
+    return false;
+  if (ctx->memory && width == ctx->width && height == ctx->height &&
+      (ctx->entityIds != nullptr) == ctx->wantEntityIds)
+    return true;
+
+  // Rows padded to whole cache lines
+  int pitch = (int)(alignUp(width * sizeof(uint32_t), CACHE_LINE) /
+                    sizeof(uint32_t));
+
+  size_t pixelBytes = alignUp((size_t)pitch * height * sizeof(uint32_t),
+                              CACHE_LINE);
+  size_t depthBytes = alignUp(width * sizeof(float), CACHE_LINE);
+  size_t clipBytes = alignUp(width * sizeof(int), CACHE_LINE);
+  int tiles = (width + DEPTH_TILE_SIZE - 1) / DEPTH_TILE_SIZE;
+  size_t tileBytes = alignUp(tiles * sizeof(float), CACHE_LINE);
+  size_t idBytes =
+      ctx->wantEntityIds
+          ? alignUp((size_t)width * height * sizeof(uint32_t), CACHE_LINE)
+          : 0;
+
+  size_t size = pixelBytes + depthBytes + clipBytes * 3 + tileBytes * 2 +
+                idBytes;
+  size = alignUp(size, ctx->hugePages ? HUGE_PAGE : CACHE_LINE);
+
+  freeBuffers(ctx);
+
+  bool mapped = false;
+  char *memory = (char *)allocateBuffers(size, ctx->hugePages, &mapped);
+  if (!memory) {
+    printf("ERROR: Could not allocate a %dx%d render context\n", width,
+           height);
+    ctx->width = ctx->height = ctx->pitch = 0;
+    ctx->pixels = ctx->framebuffer = nullptr;
+    ctx->framebufferPitch = 0;
+    ctx->zBuffer = nullptr;
+    ctx->depthTileMin = ctx->depthTileMax = nullptr;
+    ctx->wallTop = ctx->wallBottom = nullptr;
+    ctx->spriteColumns = nullptr;
+    ctx->entityIds = nullptr;
+    return false;
+  }
+
+  ctx->memory = memory;
+  ctx->memorySize = size;
+  ctx->mappedHugePages = mapped;
+
+  ctx->width = width;
+  ctx->height = height;
+  ctx->pitch = pitch;
+  ctx->pixels = ctx->framebuffer = (uint32_t *)memory;
+  ctx->framebufferPitch = pitch;
+  ctx->zBuffer = (float *)(memory + pixelBytes);
+  ctx->wallTop = (int *)(memory + pixelBytes + depthBytes);
+  ctx->wallBottom = (int *)(memory + pixelBytes + depthBytes + clipBytes);
+  ctx->spriteColumns =
+      (int32_t *)(memory + pixelBytes + depthBytes + clipBytes * 2);
+  char *tileMemory = memory + pixelBytes + depthBytes + clipBytes * 3;
+  ctx->depthTileMin = (float *)tileMemory;
+  ctx->depthTileMax = (float *)(tileMemory + tileBytes);
+  ctx->entityIds =
+      idBytes ? (uint32_t *)(tileMemory + tileBytes * 2) : nullptr;
+  ctx->entityFrame = 0;
+
+  memset(ctx->pixels, 0, pixelBytes);
+  for (int x = 0; x < width; x++)
+    ctx->zBuffer[x] = 1e30f; // nothing drawn yet - everything is visible
+  updateDepthTiles(ctx);
+  // Entries from frame 0 never count, so zeroed ones are empty
+  if (idBytes)
+    memset(ctx->entityIds, 0, idBytes);
+
+  return true;
+}
+
+bool setEntityIdBuffer(RenderContext *ctx, bool enabled) {
+  ctx->wantEntityIds = enabled;
+  return resizeRenderContext(ctx, ctx->width, ctx->height);
+}
+
+void beginEntityIds(RenderContext *ctx) {
+  if (!ctx->entityIds)
+    return;
+
+  // The frame number is 16 bits; when it wraps round, entries from the
+  // last time round would count again, so wipe them
+  ctx->entityFrame = (ctx->entityFrame + 1) & 0xFFFF;
+  if (ctx->entityFrame == 0) {
+    memset(ctx->entityIds, 0,
+           (size_t)ctx->width * ctx->height * sizeof(uint32_t));
+    ctx->entityFrame = 1;
+  }
+}
+
+int entityIdAt(const RenderContext *ctx, int x, int y) {
+  if (!ctx->entityIds || !ctx->entityFrame || x < 0 || x >= ctx->width ||
+      y < 0 || y >= ctx->height)
+    return -1;
+  uint32_t entry = ctx->entityIds[y * ctx->width + x];
+  return entry >> 16 == ctx->entityFrame ? (int)(entry & ENTITY_ID_MAX) : -1;
+}
+
+void updateDepthTiles(RenderContext *ctx) {
+  const float *zBuffer = ctx->zBuffer;
+  for (int x0 = 0, tile = 0; x0 < ctx->width; x0 += DEPTH_TILE_SIZE, tile++) {
+    int x1 = std::min(x0 + DEPTH_TILE_SIZE, ctx->width);
+    float nearest = zBuffer[x0];
+    float furthest = zBuffer[x0];
+    for (int x = x0 + 1; x < x1; x++) {
+      nearest = std::min(nearest, zBuffer[x]);
+      furthest = std::max(furthest, zBuffer[x]);
+    }
+    ctx->depthTileMin[tile] = nearest;
+    ctx->depthTileMax[tile] = furthest;
+  }
+}
+
+bool depthTestSpan(const RenderContext *ctx, float depth, int *x0, int *x1,
+                   bool *allVisible) {
+  const float *zBuffer = ctx->zBuffer;
+  int left = *x0;
+  int right = *x1;
+
+  // In from the left: skip tiles with nothing behind `depth`, then columns
+  while (left < right) {
+    int tileEnd = std::min(right, (left | (DEPTH_TILE_SIZE - 1)) + 1);
+    if (!(depth < ctx->depthTileMax[left >> DEPTH_TILE_SHIFT])) {
+      left = tileEnd;
+      continue;
+    }
+    while (left < tileEnd && !(depth < zBuffer[left]))
+      left++;
+    if (left < tileEnd)
+      break;
+  }
+  if (left >= right)
+    return false;
+
+  // And in from the right; column `left` passes, so this stops there
+  while (!(depth < zBuffer[right - 1])) {
+    int tileStart = std::max(left, (right - 1) & ~(DEPTH_TILE_SIZE - 1));
+    if (!(depth < ctx->depthTileMax[(right - 1) >> DEPTH_TILE_SHIFT]))
+      right = tileStart;
+    else
+      right--;
+  }
+
+  *allVisible = true;
+  for (int tile = left >> DEPTH_TILE_SHIFT;
+       tile <= (right - 1) >> DEPTH_TILE_SHIFT; tile++) {
+    if (!(depth < ctx->depthTileMin[tile])) {
+      *allVisible = false;
+      break;
+    }
+  }
+
+  *x0 = left;
+  *x1 = right;
+  return true;
+}
+
+void setRenderTarget(RenderContext *ctx, uint32_t *pixels, int pitch) {
+  if (pixels) {
+    ctx->pixels = pixels;
+    ctx->pitch = pitch;
+  } else {
+    ctx->pixels = ctx->framebuffer;
+    ctx->pitch = ctx->framebufferPitch;
+  }
+}
+
+void destroyRenderContext(RenderContext *ctx) {
+  freeBuffers(ctx);
+  memset(ctx, 0, sizeof(*ctx));
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// zBuffer columns per depth tile
+#define DEPTH_TILE_SHIFT 5
+#define DEPTH_TILE_SIZE (1 << DEPTH_TILE_SHIFT)
+
+// Everything the renderer draws into, sized at runtime so the resolution
+// can change without restarting. The framebuffer, depth and scratch
+// buffers share one allocation; each starts on a cache line and framebuffer
+// rows are padded to whole cache lines, so `pitch` may be a bit more than
+// `width`.
+struct RenderContext {
+  uint32_t *pixels; // ARGB framebuffer, pitch pixels per row
+  int width;
+  int height;
+  int pitch;
+
+  float *zBuffer; // per column: distance to the wall drawn there
+
+  // Nearest and furthest zBuffer entry in each run of DEPTH_TILE_SIZE
+  // columns, kept up to date by updateDepthTiles
+  float *depthTileMin;
+  float *depthTileMax;
+
+  // Optional entity IDs, one per pixel in rows of `width`: the ID of the
+  // billboard drawn there, tagged with the frame that drew it (see
+  // setEntityIdBuffer). Null unless turned on.
+  uint32_t *entityIds;
+  uint32_t entityFrame;
+  bool wantEntityIds;
+
+  // Scratch: per-column wall extents written by the wall pass and read by
+  // the floor/ceiling span pass
+  int *wallTop;
+  int *wallBottom;
+  // Scratch for the SIMD sprite blits: the source column each screen
+  // column of a blit samples, with room for width rounded up to 16
+  int32_t *spriteColumns;
+
+  // The context's own framebuffer, which `pixels` points back to unless a
+  // render target is set
+  uint32_t *framebuffer;
+  int framebufferPitch;
+
+  // Backing memory
+  void *memory;
+  size_t memorySize;
+  bool hugePages;       // huge pages were requested
+  bool mappedHugePages; // memory came from an explicit MAP_HUGETLB mapping
+};
+
+// With hugePages the buffers are backed by 2 MB pages when the OS allows:
+// an explicit hugetlb mapping if any are reserved, otherwise a 2 MB aligned
+// block marked for transparent huge pages. Either way it quietly falls back
+// to normal pages.
+bool createRenderContext(RenderContext *ctx, int width, int height,
+                         bool hugePages = false);
+bool resizeRenderContext(RenderContext *ctx, int width, int height);
+void destroyRenderContext(RenderContext *ctx);
+
+// Rebuilds depthTileMin/Max from zBuffer. Whatever writes zBuffer calls
+// this once it is done.
+void updateDepthTiles(RenderContext *ctx);
+
+// Narrows columns [*x0, *x1) to the span from the first to the last column
+// where something at `depth` is in front of the wall (depth < zBuffer),
+// skipping whole tiles at a time. False if there is no such column;
+// otherwise *allVisible says whether every column in the span passes,
+// judged by tile, so it may be false when they all do.
+bool depthTestSpan(const RenderContext *ctx, float depth, int *x0, int *x1,
+                   bool *allVisible);
+
+// Entity IDs: with the buffer turned on, billboards that have an ID write
+// it under every pixel they draw, so what is at a point on screen is a
+// single lookup. Each entry carries the frame it was written in, so the
+// buffer never needs clearing: beginEntityIds starts a new frame and older
+// entries stop counting. IDs go up to ENTITY_ID_MAX.
+#define ENTITY_ID_MAX 0xFFFF
+
+// Turns the buffer on or off for a created context, reallocating it
+bool setEntityIdBuffer(RenderContext *ctx, bool enabled);
+void beginEntityIds(RenderContext *ctx);
+// The entry a billboard with `id` writes this frame
+inline uint32_t entityIdEntry(const RenderContext *ctx, int id) {
+  return ctx->entityFrame << 16 | (uint32_t)id;
+}
+// ID drawn at (x, y) this frame, or -1 if none (or the buffer is off)
+int entityIdAt(const RenderContext *ctx, int x, int y);
+
+// Points the context at pixels it doesn't own, such as a locked streaming
+// texture, so frames are drawn straight into them. pitch is in pixels. The
+// renderer only ever writes the framebuffer, so uncached or write-combined
+// memory is fine. Passing nullptr goes back to the context's own buffer,
+// as does resizing it to a new size.
+void setRenderTarget(RenderContext *ctx, uint32_t *pixels, int pitch);
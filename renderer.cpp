@@ -1,132 +1,154 @@
 #include "renderer.h"
+#include "lighting.h"
 #include "map.h"
 #include "player.h"
+#include "raycast.h"
 #include "sprite.h"
+#include "texture.h"
+#include "threadpool.h"
+#include "wallslice.h"
 #include <algorithm>
 #include <cmath>
+#include <vector>
 
 const float FOV = M_PI / 3.0f;
 const float MAX_DIST = 20.0f;
 
-static Sprite wallTexture;
-static Sprite ceilingTexture;
-static float zBuffer[1920]; // Max screen width
+static MipTexture wallTexture;
+static MipTexture ceilingTexture;
+static MipTexture floorTexture;
 
-bool loadWallTexture(const char *filename) {
-  return loadSprite(&wallTexture, filename);
+// World units to texture repeats for the ceiling and floor
+static const float FLAT_TEXTURE_SCALE = 0.6f;
+
+// Distance fog: shade = 1 / (1 + dist^2 * falloff)
+static const float WALL_FALLOFF = 0.08f;
+static const float FLAT_FALLOFF = 0.1f;
+
+// Most cells the minimap shows along each side
+static const int MINIMAP_CELLS = 24;
+
+// All three build their mip chain at load time
+bool loadWallTexture(const char *filename, TextureLayout layout) {
+  freeMipTexture(&wallTexture);
+  return loadMipTexture(&wallTexture, filename, layout);
 }
 
 bool loadCeilingTexture(const char *filename) {
-  return loadSprite(&ceilingTexture, filename);
+  freeMipTexture(&ceilingTexture);
+  return loadMipTexture(&ceilingTexture, filename, TEXTURE_ROW_MAJOR);
 }
 
-void cleanupWallTexture() {
-  if (wallTexture.pixels) {
-    delete[] wallTexture.pixels;
-    wallTexture.pixels = nullptr;
-  }
+bool loadFloorTexture(const char *filename) {
+  freeMipTexture(&floorTexture);
+  return loadMipTexture(&floorTexture, filename, TEXTURE_ROW_MAJOR);
 }
 
-static void drawPixel(uint32_t *pixels, int WIDTH, int HEIGHT, int x, int y,
-                      uint32_t color) {
-  if (x >= 0 && x < WIDTH && y >= 0 && y < HEIGHT)
-    pixels[y * WIDTH + x] = color;
+bool createWallTexture(const uint32_t *argb, int width, int height,
+                       TextureLayout layout) {
+  freeMipTexture(&wallTexture);
+  return createMipTexture(&wallTexture, argb, width, height, layout);
 }
 
-// DDA Raycasting - much faster and more accurate
-static RayHit castRayDDA(float angle) {
-  RayHit hit;
-
-  float dirX = cos(angle);
-  float dirY = sin(angle);
-
-  // Starting position
-  int mapX = (int)playerX;
-  int mapY = (int)playerY;
-
-  // Length of ray from one side to next in map
-  float deltaDistX = fabs(1.0f / dirX);
-  float deltaDistY = fabs(1.0f / dirY);
-
-  // Direction to step in (+1 or -1)
-  int stepX = dirX > 0 ? 1 : -1;
-  int stepY = dirY > 0 ? 1 : -1;
-
-  // Initial side distances
-  float sideDistX = (dirX > 0) ? (mapX + 1.0f - playerX) * deltaDistX
-                               : (playerX - mapX) * deltaDistX;
-
-  float sideDistY = (dirY > 0) ? (mapY + 1.0f - playerY) * deltaDistY
-                               : (playerY - mapY) * deltaDistY;
-
-  // DDA algorithm
-  bool hitWall = false;
-  bool vertical = false;
-
-  while (!hitWall && mapX >= 0 && mapX < MAP_SIZE && mapY >= 0 &&
-         mapY < MAP_SIZE) {
-    // Jump to next map square
-    if (sideDistX < sideDistY) {
-      sideDistX += deltaDistX;
-      mapX += stepX;
-      vertical = true;
-    } else {
-      sideDistY += deltaDistY;
-      mapY += stepY;
-      vertical = false;
-    }
+void cleanupWallTexture() {
+  freeMipTexture(&wallTexture);
+  freeMipTexture(&ceilingTexture);
+  freeMipTexture(&floorTexture);
+}
 
-    // Check for wall
-    if (mapX >= 0 && mapX < MAP_SIZE && mapY >= 0 && mapY < MAP_SIZE) {
-      if (getMapTile(mapY, mapX) == 1) {
-        hitWall = true;
-      }
-    } else {
-      break; // Out of bounds
-    }
-  }
+static ShadingMode shadingMode = SHADING_COLORMAP;
 
-  // Calculate distance
-  float distance;
-  if (vertical) {
-    distance = (mapX - playerX + (1 - stepX) / 2) / dirX;
-  } else {
-    distance = (mapY - playerY + (1 - stepY) / 2) / dirY;
-  }
+void setShadingMode(ShadingMode mode) { shadingMode = mode; }
+ShadingMode getShadingMode() { return shadingMode; }
 
-  hit.distance = distance;
-  hit.hitX = playerX + dirX * distance;
-  hit.hitY = playerY + dirY * distance;
-  hit.vertical = vertical;
+// Original per-pixel float shading, kept to validate the light tables
+static inline uint32_t shadeFloat(uint32_t texColor, float shade) {
+  uint8_t r = ((texColor >> 16) & 0xFF) * shade;
+  uint8_t g = ((texColor >> 8) & 0xFF) * shade;
+  uint8_t b = (texColor & 0xFF) * shade;
 
-  return hit;
+  return (0xFF << 24) | (r << 16) | (g << 8) | b;
 }
 
-void render3DView(uint32_t *pixels, int WIDTH, int HEIGHT) {
-  // Clear z-buffer
-  for (int i = 0; i < WIDTH; i++)
-    zBuffer[i] = MAX_DIST;
-
-  // Camera direction
-  float dirX = cos(playerAngle);
-  float dirY = sin(playerAngle);
-
-  // Camera plane
-  float planeX = -dirY * tan(FOV / 2.0f);
-  float planeY = dirX * tan(FOV / 2.0f);
+static void drawPixel(RenderContext *ctx, int x, int y, uint32_t color) {
+  if (x >= 0 && x < ctx->width && y >= 0 && y < ctx->height)
+    ctx->pixels[y * ctx->pitch + x] = color;
+}
 
+// Everything a column strip needs to render, shared by all workers
+struct ViewSetup {
+  RenderContext *ctx;
+  uint32_t *pixels;
+  int WIDTH;
+  int HEIGHT;
+  int pitch;
+  float dirX, dirY;     // camera direction
+  float planeX, planeY; // camera plane
+  float planeLength;    // tan(FOV / 2)
+  int stripWidth;
+  int bandHeight;
+  bool floatShading; // SHADING_FLOAT reference path
+};
+
+// Strips are a multiple of 16 columns and the context's rows and zBuffer are
+// cache-line aligned, so neighbouring workers never share a cache line
+static const int STRIP_ALIGN = 16;
+static const int STRIPS_PER_THREAD = 4;
+
+// Columns whose rays are cast and marked visible together
+static const int RAY_BATCH = 16;
+
+// Camera-space ray table: rayTable[x] is how far along the camera plane
+// column x's ray points, i.e. cameraX * tan(FOV / 2). It only depends on the
+// screen width and FOV, so it is rebuilt only when one of those changes.
+static std::vector<float> rayTable;
+static int rayTableWidth = 0;
+static float rayTableFOV = 0.0f;
+
+static void updateRayTable(int WIDTH) {
+  if (rayTableWidth == WIDTH && rayTableFOV == FOV)
+    return;
+
+  float planeLength = tanf(FOV / 2.0f);
+  rayTable.resize(WIDTH);
   for (int x = 0; x < WIDTH; x++) {
-    // camera space X
     float cameraX = 2.0f * x / (float)WIDTH - 1.0f;
+    rayTable[x] = cameraX * planeLength;
+  }
 
-    // ray direction
-    float rayDirX = dirX + planeX * cameraX;
-    float rayDirY = dirY + planeY * cameraX;
+  rayTableWidth = WIDTH;
+  rayTableFOV = FOV;
+}
 
-    float rayAngle = atan2(rayDirY, rayDirX);
+static void renderColumns(const ViewSetup &view, int xStart, int xEnd) {
+  uint32_t *pixels = view.pixels;
+  int HEIGHT = view.HEIGHT;
+  int pitch = view.pitch;
+  float *zBuffer = view.ctx->zBuffer;
+  int *wallTop = view.ctx->wallTop;
+  int *wallBottom = view.ctx->wallBottom;
+  float dirX = view.dirX;
+  float dirY = view.dirY;
+
+  float rayDirX[RAY_BATCH], rayDirY[RAY_BATCH];
+  RayHit hits[RAY_BATCH];
+
+  for (int x = xStart; x < xEnd; x++) {
+    // Cast the rays a batch of columns at a time, then mark the cells
+    // they crossed while the batch is still hot
+    if ((x - xStart) % RAY_BATCH == 0) {
+      int batch = std::min(RAY_BATCH, xEnd - x);
+      for (int i = 0; i < batch; i++) {
+        // ray direction = dir + perp(dir) * rayTable[x]
+        rayDirX[i] = dirX - dirY * rayTable[x + i];
+        rayDirY[i] = dirY + dirX * rayTable[x + i];
+      }
+      castRays(rayDirX, rayDirY, batch, hits);
+      markVisibleCells(rayDirX, rayDirY, hits, batch);
+    }
 
-    // cast ray
-    RayHit hit = castRayDDA(rayAngle);
+    // distance comes back perpendicular to the camera plane
+    const RayHit &hit = hits[(x - xStart) % RAY_BATCH];
 
     float dist = hit.distance;
     if (dist < 0.0001f)
@@ -146,47 +168,9 @@ void render3DView(uint32_t *pixels, int WIDTH, int HEIGHT) {
     if (drawEnd >= HEIGHT)
       drawEnd = HEIGHT - 1;
 
-    //
-    // CEILING CASTING (STATIC)
-    //
-    for (int y = 0; y < drawStart; y++) {
-      float p = (HEIGHT / 2.0f) - y;
-      if (p == 0)
-        p = 0.0001f;
-
-      float rowDist = (HEIGHT / 2.0f) / p;
-
-      float worldX = playerX + rowDist * rayDirX;
-      float worldY = playerY + rowDist * rayDirY;
-
-      float fracX = (worldX * 0.6f) - floorf(worldX * 0.6f);
-      float fracY = (worldY * 0.6f) - floorf(worldY * 0.6f);
-
-      int texX = (int)(fracX * ceilingTexture.width);
-      int texY = (int)(fracY * ceilingTexture.height);
-
-      if (texX < 0)
-        texX = 0;
-      if (texY < 0)
-        texY = 0;
-      if (texX >= ceilingTexture.width)
-        texX = ceilingTexture.width - 1;
-      if (texY >= ceilingTexture.height)
-        texY = ceilingTexture.height - 1;
-
-      uint32_t texColor =
-          ceilingTexture.pixels[texY * ceilingTexture.width + texX];
-
-      float fog = 1.0f / (1.0f + rowDist * rowDist * 0.1f);
-
-      uint8_t r = ((texColor >> 16) & 0xFF) * fog;
-      uint8_t g = ((texColor >> 8) & 0xFF) * fog;
-      uint8_t b = (texColor & 0xFF) * fog;
-
-      uint32_t shaded = (0xFF << 24) | (r << 16) | (g << 8) | b;
-
-      drawPixel(pixels, WIDTH, HEIGHT, x, y, shaded);
-    }
+    // Remember where the wall is so the span pass can fill around it
+    wallTop[x] = drawStart;
+    wallBottom[x] = drawEnd;
 
     //
     // WALL TEXTURE X - FIXED: Use actual hit position
@@ -200,53 +184,209 @@ void render3DView(uint32_t *pixels, int WIDTH, int HEIGHT) {
 
     wallX -= floorf(wallX);
 
-    int wallTexX = (int)(wallX * wallTexture.width);
-
-    if (wallTexX < 0)
-      wallTexX = 0;
-    if (wallTexX >= wallTexture.width)
-      wallTexX = wallTexture.width - 1;
+    // distance shading, picked once for the whole column
+    float shadeFactor = 1.0f / (1.0f + dist * dist * WALL_FALLOFF);
+    int shadeLevel = lightLevel(shadeFactor);
+    const uint8_t *light = lightTable[shadeLevel].data();
 
     //
     // DRAW WALL (CORRECT TEXTURE PROJECTION)
     //
-    for (int y = drawStart; y <= drawEnd; y++) {
-      int d = y * 256 - HEIGHT * 128 + wallHeight * 128;
+    if (wallHeight < 1)
+      wallHeight = 1;
 
-      int texY = ((d * wallTexture.height) / wallHeight) / 256;
+    // Mip level: how many texels of the full-size texture land on one
+    // screen pixel down this column
+    const MipTexture &mip = wallTexture;
+    int mipLevel =
+        mipLevelFor(&mip, (float)mip.levels[0].height / wallHeight);
+    const Texture &tex = mip.levels[mipLevel];
 
-      if (texY < 0)
-        texY = 0;
-      if (texY >= wallTexture.height)
-        texY = wallTexture.height - 1;
+    int wallTexX = (int)(wallX * tex.width);
 
-      uint32_t texColor =
-          wallTexture.pixels[texY * wallTexture.width + wallTexX];
+    if (wallTexX < 0)
+      wallTexX = 0;
+    if (wallTexX >= tex.width)
+      wallTexX = tex.width - 1;
+
+    // texY = (y - HEIGHT/2 + wallHeight/2) * texHeight / wallHeight, stepped
+    // in 16.16 fixed point down the column. With an odd HEIGHT and an even
+    // wallHeight the wall starts half a pixel above the texture; that row
+    // is clamped to texel row 0 rather than wrapping round to the last one.
+    int texStep = (int)(((int64_t)tex.height << 16) / wallHeight);
+    int texPos = (int)std::max<int64_t>(
+        0, (int64_t)(2 * drawStart - HEIGHT + wallHeight) * tex.height *
+               (1 << 15) / wallHeight);
+
+    const uint32_t *texColumn = texelAddress(&tex, wallTexX, 0);
+    int texStride = columnStride(&tex);
+    uint32_t *dst = pixels + drawStart * pitch + x;
+
+    // Common case goes to the (possibly SIMD) slice kernel
+    if (!view.floatShading && tex.powerOfTwo &&
+        tex.layout == TEXTURE_COLUMN_MAJOR) {
+      drawWallSlice(dst, pitch, drawEnd - drawStart + 1, texColumn, texPos,
+                    texStep, tex.heightMask, shadeLevel);
+      continue;
+    }
 
-      // distance shading
-      float shadeFactor = 1.0f / (1.0f + dist * dist * 0.08f);
+    for (int y = drawStart; y <= drawEnd; y++, texPos += texStep) {
+      int texY = texPos >> 16;
 
-      uint8_t r = ((texColor >> 16) & 0xFF) * shadeFactor;
-      uint8_t g = ((texColor >> 8) & 0xFF) * shadeFactor;
-      uint8_t b = (texColor & 0xFF) * shadeFactor;
+      if (tex.powerOfTwo) {
+        texY &= tex.heightMask;
+      } else {
+        if (texY < 0)
+          texY = 0;
+        if (texY >= tex.height)
+          texY = tex.height - 1;
+      }
 
-      uint32_t shaded = (0xFF << 24) | (r << 16) | (g << 8) | b;
+      uint32_t texColor = texColumn[texY * texStride];
 
-      drawPixel(pixels, WIDTH, HEIGHT, x, y, shaded);
+      *dst = view.floatShading ? shadeFloat(texColor, shadeFactor)
+                               : applyLight(texColor, light);
+      dst += pitch;
     }
+  }
+}
 
-    //
-    // FLOOR
-    //
-    for (int y = drawEnd + 1; y < HEIGHT; y++) {
-      drawPixel(pixels, WIDTH, HEIGHT, x, y, 0xFF0f0f0f);
+// Wraps a 16.16 texture coordinate into [0, size)
+static inline int wrapTexel(int64_t coord, int size) {
+  int t = (int)(coord >> 16);
+  if ((size & (size - 1)) == 0)
+    return t & (size - 1);
+  t %= size;
+  return t < 0 ? t + size : t;
+}
+
+//
+// FLOOR / CEILING CASTING (HORIZONTAL SPANS)
+//
+// Every pixel of a row is the same distance away, so the distance, fog and
+// texture step are worked out once per row and the row is walked left to
+// right in 16.16 fixed point
+static void renderFlatRow(const ViewSetup &view, int y) {
+  int WIDTH = view.WIDTH;
+  int HEIGHT = view.HEIGHT;
+
+  // The middle row is always covered by wall
+  if (y == HEIGHT / 2)
+    return;
+
+  bool ceiling = y < HEIGHT / 2;
+  uint32_t *row = view.pixels + y * view.pitch;
+  const int *wallTop = view.ctx->wallTop;
+  const int *wallBottom = view.ctx->wallBottom;
+  const MipTexture &mip = ceiling ? ceilingTexture : floorTexture;
+
+  if (mip.levelCount == 0) {
+    for (int x = 0; x < WIDTH; x++) {
+      if (ceiling ? y < wallTop[x] : y > wallBottom[x])
+        row[x] = 0xFF0f0f0f;
     }
+    return;
+  }
+
+  float p = ceiling ? (HEIGHT / 2.0f) - y : y - (HEIGHT / 2.0f);
+  float rowDist = (HEIGHT / 2.0f) / p;
+  float fog = 1.0f / (1.0f + rowDist * rowDist * FLAT_FALLOFF);
+  const uint8_t *light = lightTable[lightLevel(fog)].data();
+
+  // Mip level from how many full-size texels one pixel of this row spans
+  float worldPerPixel = rowDist * 2.0f * view.planeLength / WIDTH;
+  float texelsPerPixel =
+      worldPerPixel * FLAT_TEXTURE_SCALE * mip.levels[0].width;
+  const Texture &tex = mip.levels[mipLevelFor(&mip, texelsPerPixel)];
+
+  // World position under the leftmost pixel (cameraX = -1) and the step
+  // to the next pixel, both scaled to texels
+  float scaleU = FLAT_TEXTURE_SCALE * tex.width;
+  float scaleV = FLAT_TEXTURE_SCALE * tex.height;
+
+  float u = (playerX + rowDist * (view.dirX - view.planeX)) * scaleU;
+  float v = (playerY + rowDist * (view.dirY - view.planeY)) * scaleV;
+  u -= floorf(u / tex.width) * tex.width;
+  v -= floorf(v / tex.height) * tex.height;
+
+  int64_t texU = (int64_t)(u * 65536.0f);
+  int64_t texV = (int64_t)(v * 65536.0f);
+  int64_t stepU =
+      (int64_t)(rowDist * 2.0f * view.planeX / WIDTH * scaleU * 65536.0f);
+  int64_t stepV =
+      (int64_t)(rowDist * 2.0f * view.planeY / WIDTH * scaleV * 65536.0f);
+
+  for (int x = 0; x < WIDTH; x++, texU += stepU, texV += stepV) {
+    // Leave the pixels the column pass already covered with wall
+    if (ceiling ? y >= wallTop[x] : y <= wallBottom[x])
+      continue;
+
+    int texX = wrapTexel(texU, tex.width);
+    int texY = wrapTexel(texV, tex.height);
+    uint32_t texColor = tex.pixels[texY * tex.width + texX];
+
+    row[x] = view.floatShading ? shadeFloat(texColor, fog)
+                               : applyLight(texColor, light);
   }
 }
-float *getZBuffer() { return zBuffer; }
 
-void renderMinimap(uint32_t *pixels, int WIDTH, int HEIGHT) {
-  int tile = WIDTH / 80;
+static void renderBandJob(void *userData, int band) {
+  const ViewSetup &view = *(const ViewSetup *)userData;
+  int yStart = band * view.bandHeight;
+  int yEnd = std::min(yStart + view.bandHeight, view.HEIGHT);
+  for (int y = yStart; y < yEnd; y++)
+    renderFlatRow(view, y);
+}
+
+static void renderStripJob(void *userData, int strip) {
+  const ViewSetup &view = *(const ViewSetup *)userData;
+  int xStart = strip * view.stripWidth;
+  int xEnd = std::min(xStart + view.stripWidth, view.WIDTH);
+  if (xStart < xEnd)
+    renderColumns(view, xStart, xEnd);
+}
+
+void render3DView(RenderContext *ctx) {
+  int WIDTH = ctx->width;
+  int HEIGHT = ctx->height;
+
+  ViewSetup view;
+  view.ctx = ctx;
+  view.pixels = ctx->pixels;
+  view.WIDTH = WIDTH;
+  view.HEIGHT = HEIGHT;
+  view.pitch = ctx->pitch;
+  view.floatShading = shadingMode == SHADING_FLOAT;
+
+  // Camera direction
+  view.dirX = cos(playerAngle);
+  view.dirY = sin(playerAngle);
+
+  // Camera plane
+  updateRayTable(WIDTH);
+  view.planeLength = tanf(FOV / 2.0f);
+  view.planeX = -view.dirY * view.planeLength;
+  view.planeY = view.dirX * view.planeLength;
+
+  // Split the screen into column strips - every column writes its own
+  // pixels and zBuffer entry, so strips need no synchronisation
+  int strips = getThreadPoolSize() * STRIPS_PER_THREAD;
+  int stripWidth = (WIDTH + strips - 1) / strips;
+  stripWidth = (stripWidth + STRIP_ALIGN - 1) / STRIP_ALIGN * STRIP_ALIGN;
+  view.stripWidth = stripWidth;
+
+  clearVisibleCells((int)MAX_DIST);
+  runParallel(renderStripJob, &view, (WIDTH + stripWidth - 1) / stripWidth);
+  updateDepthTiles(ctx);
+
+  // Then fill ceiling and floor a row at a time, in horizontal bands
+  view.bandHeight = (HEIGHT + strips - 1) / strips;
+  runParallel(renderBandJob, &view,
+              (HEIGHT + view.bandHeight - 1) / view.bandHeight);
+}
+
+void renderMinimap(RenderContext *ctx) {
+  int tile = ctx->width / 80;
   if (tile < 3)
     tile = 3;
   if (tile > 12)
@@ -255,28 +395,34 @@ void renderMinimap(uint32_t *pixels, int WIDTH, int HEIGHT) {
   int ox = 10;
   int oy = 10;
 
-  for (int y = 0; y < MAP_SIZE; y++) {
-    for (int x = 0; x < MAP_SIZE; x++) {
-      if (!getMapTile(y, x))
+  // Big levels don't fit, so show the cells around the player
+  int cols = std::min(level.width, MINIMAP_CELLS);
+  int rows = std::min(level.height, MINIMAP_CELLS);
+  int left = std::clamp((int)playerX - cols / 2, 0, level.width - cols);
+  int top = std::clamp((int)playerY - rows / 2, 0, level.height - rows);
+
+  for (int y = 0; y < rows; y++) {
+    for (int x = 0; x < cols; x++) {
+      if (!getMapTile(top + y, left + x))
         continue;
 
       for (int dy = 0; dy < tile; dy++)
         for (int dx = 0; dx < tile; dx++)
-          drawPixel(pixels, WIDTH, HEIGHT, ox + x * tile + dx,
+          drawPixel(ctx, ox + x * tile + dx,
                     oy + y * tile + dy, 0xFF666666);
     }
   }
 
-  int px = ox + (int)(playerX * tile);
-  int py = oy + (int)(playerY * tile);
+  int px = ox + (int)((playerX - left) * tile);
+  int py = oy + (int)((playerY - top) * tile);
 
   for (int dy = -2; dy <= 2; dy++)
     for (int dx = -2; dx <= 2; dx++)
       if (dx * dx + dy * dy <= 4)
-        drawPixel(pixels, WIDTH, HEIGHT, px + dx, py + dy, 0xFFFF0000);
+        drawPixel(ctx, px + dx, py + dy, 0xFFFF0000);
 
   for (int i = 0; i < tile; i++) {
-    drawPixel(pixels, WIDTH, HEIGHT, px + (int)(cos(playerAngle) * i),
+    drawPixel(ctx, px + (int)(cos(playerAngle) * i),
               py + (int)(sin(playerAngle) * i), 0xFFFFFF00);
   }
 }
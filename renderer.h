@@ -1,19 +1,32 @@
 #pragma once
+#include "raycast.h"
+#include "rendercontext.h"
+#include "texture.h"
 #include <cstdint>
 
-struct RayHit {
-  float distance;
-  float hitX;
-  float hitY;
-  bool vertical; // hit vertical wall or horizontal wall
-};
-
 extern const float FOV;
+// View distance: walls further off are lost in the fog, and streamed maps
+// keep at least this much of the world around the player resident
+extern const float MAX_DIST;
+
+// SHADING_COLORMAP uses the quantised light tables in lighting.h,
+// SHADING_FLOAT the original per-pixel float shading (for comparison)
+enum ShadingMode { SHADING_COLORMAP, SHADING_FLOAT };
+
+void setShadingMode(ShadingMode mode);
+ShadingMode getShadingMode();
 
-float *getZBuffer(); // Add this declaration
-void render3DView(uint32_t *pixels, int WIDTH, int HEIGHT);
-void renderMinimap(uint32_t *pixels, int WIDTH, int HEIGHT);
+// Draws walls, floor and ceiling over the whole frame and fills
+// ctx->zBuffer and its depth tiles for the sprite passes, and the visible
+// cells (see raycast.h) for culling entities
+void render3DView(RenderContext *ctx);
+void renderMinimap(RenderContext *ctx);
 
 bool loadCeilingTexture(const char *filename);
-bool loadWallTexture(const char *filename);
+bool loadFloorTexture(const char *filename);
+bool loadWallTexture(const char *filename,
+                     TextureLayout layout = TEXTURE_COLUMN_MAJOR);
+// Same, from row-major ARGB pixels already in memory
+bool createWallTexture(const uint32_t *argb, int width, int height,
+                       TextureLayout layout = TEXTURE_COLUMN_MAJOR);
 void cleanupWallTexture();
@@ -0,0 +1,124 @@
+#include "resolution.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Scales move in steps of 5% of the output size
+static const float SCALE_STEP = 0.05f;
+
+// Smoothing for the frame time average, roughly the last 10 frames
+static const float AVERAGE_WEIGHT = 0.1f;
+
+// Frames to wait after a change, long enough for the average to catch up
+static const int SETTLE_FRAMES = 30;
+
+// Only scale up once frames fit in this fraction of the budget. Cost goes
+// with pixel count, so one step up costs at most (0.55 / 0.5)^2 = 1.21x and
+// lands back under budget instead of over it.
+static const float HEADROOM = 0.75f;
+
+void initResolutionController(ResolutionController *ctl, float budgetMs,
+                              float minScale) {
+  ctl->budgetMs = budgetMs;
+  ctl->scale = 1.0f;
+  ctl->minScale = minScale;
+  ctl->averageMs = 0.0f;
+  ctl->settleFrames = SETTLE_FRAMES;
+}
+
+static float quantiseScale(float scale) {
+  return std::floor(scale / SCALE_STEP + 0.001f) * SCALE_STEP;
+}
+
+bool updateResolutionController(ResolutionController *ctl, float frameMs) {
+  if (ctl->averageMs == 0.0f)
+    ctl->averageMs = frameMs;
+  else
+    ctl->averageMs += (frameMs - ctl->averageMs) * AVERAGE_WEIGHT;
+
+  if (ctl->settleFrames > 0) {
+    ctl->settleFrames--;
+    return false;
+  }
+
+  float scale = ctl->scale;
+  if (ctl->averageMs > ctl->budgetMs) {
+    // Over budget: jump straight to the scale that should fit, assuming
+    // cost goes with pixel count, and always at least one step down
+    float fit = scale * std::sqrt(ctl->budgetMs / ctl->averageMs);
+    scale = std::min(quantiseScale(fit), scale - SCALE_STEP);
+  } else if (ctl->averageMs < ctl->budgetMs * HEADROOM) {
+    scale += SCALE_STEP;
+  }
+  scale = std::max(ctl->minScale, std::min(scale, 1.0f));
+
+  if (std::fabs(scale - ctl->scale) < SCALE_STEP * 0.5f)
+    return false;
+
+  ctl->scale = scale;
+  ctl->settleFrames = SETTLE_FRAMES;
+  return true;
+}
+
+void scaledResolution(const ResolutionController *ctl, int outWidth,
+                      int outHeight, int *width, int *height) {
+  // Widths stay a multiple of 4 so rows keep whole 16-byte groups
+  int w = ((int)(outWidth * ctl->scale + 0.5f) + 3) & ~3;
+  int h = (int)(outHeight * ctl->scale + 0.5f);
+  *width = std::max(16, std::min(w, outWidth));
+  *height = std::max(16, std::min(h, outHeight));
+}
+
+struct UpscaleJob {
+  const RenderContext *src;
+  RenderContext *dst;
+  const int *sourceColumn; // source x for every output column
+  int bandHeight;
+};
+
+static void upscaleBandJob(void *userData, int band) {
+  const UpscaleJob &job = *(const UpscaleJob *)userData;
+  const RenderContext *src = job.src;
+  RenderContext *dst = job.dst;
+
+  int yStart = band * job.bandHeight;
+  int yEnd = std::min(yStart + job.bandHeight, dst->height);
+  int64_t yStep = ((int64_t)src->height << 16) / dst->height;
+
+  // Repeated rows are gathered from src again rather than copied from the
+  // row above: dst may be a locked, write-combined texture, and reading
+  // that back is far slower than the cached source
+  for (int y = yStart; y < yEnd; y++) {
+    int sy = (int)((y * yStep) >> 16);
+    uint32_t *out = dst->pixels + y * dst->pitch;
+    const uint32_t *in = src->pixels + sy * src->pitch;
+    for (int x = 0; x < dst->width; x++)
+      out[x] = in[job.sourceColumn[x]];
+  }
+}
+
+void upscaleNearest(const RenderContext *src, RenderContext *dst) {
+  // Column lookup, rebuilt only when either width changes
+  static std::vector<int> sourceColumn;
+  static int tableSrcWidth = 0;
+  static int tableDstWidth = 0;
+  if (tableSrcWidth != src->width || tableDstWidth != dst->width) {
+    sourceColumn.resize(dst->width);
+    int64_t xStep = ((int64_t)src->width << 16) / dst->width;
+    for (int x = 0; x < dst->width; x++)
+      sourceColumn[x] = (int)((x * xStep) >> 16);
+    tableSrcWidth = src->width;
+    tableDstWidth = dst->width;
+  }
+
+  UpscaleJob job;
+  job.src = src;
+  job.dst = dst;
+  job.sourceColumn = sourceColumn.data();
+
+  int bands = getThreadPoolSize() * 4;
+  job.bandHeight = (dst->height + bands - 1) / bands;
+  runParallel(upscaleBandJob, &job,
+              (dst->height + job.bandHeight - 1) / job.bandHeight);
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "rendercontext.h"
+
+// Dynamic resolution: the 3D view is rendered at `scale` times the output
+// size and stretched up to it. The controller watches frame times and moves
+// the scale to keep them inside a budget.
+//
+// It only drops the scale when the smoothed frame time is over budget and
+// only raises it again once there is clear headroom, and it waits a few
+// frames after every change for the timings to settle, so it doesn't bounce
+// between two sizes.
+struct ResolutionController {
+  float budgetMs;  // target frame time
+  float scale;     // current render scale, minScale..1
+  float minScale;
+  float averageMs; // smoothed frame time
+  int settleFrames; // frames left before the next change is allowed
+};
+
+void initResolutionController(ResolutionController *ctl, float budgetMs,
+                              float minScale = 0.5f);
+
+// Feeds in the last frame's time; returns true if the scale changed
+bool updateResolutionController(ResolutionController *ctl, float frameMs);
+
+// Render size for the current scale, never bigger than the output
+void scaledResolution(const ResolutionController *ctl, int outWidth,
+                      int outHeight, int *width, int *height);
+
+// Nearest-neighbour stretch of src's image over all of dst, done in 16.16
+// fixed point. Rows that sample the same source row are copied from the one
+// above.
+void upscaleNearest(const RenderContext *src, RenderContext *dst);
@@ -1,9 +1,62 @@
 #include "sprite.h"
+#include "cpu.h"
+#include <algorithm>
 #include <cstdio>
 
+#if HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+static bool isOpaque(uint32_t pixel) { return (pixel >> 24) >= 128; }
+
+// Cuts every column into runs of opaque texels and copies those texels out
+// column by column, the way Doom stores its patches
+static void buildPosts(Sprite *sprite) {
+  int width = sprite->width;
+  int height = sprite->height;
+  const uint32_t *pixels = sprite->pixels;
+
+  int postCount = 0;
+  int texelCount = 0;
+  for (int x = 0; x < width; x++) {
+    for (int y = 0; y < height; y++) {
+      if (!isOpaque(pixels[y * width + x]))
+        continue;
+      if (y == 0 || !isOpaque(pixels[(y - 1) * width + x]))
+        postCount++;
+      texelCount++;
+    }
+  }
+
+  sprite->posts = new SpritePost[postCount];
+  sprite->columnPosts = new int[width + 1];
+  sprite->postPixels = new uint32_t[texelCount];
+
+  int post = 0;
+  int texel = 0;
+  for (int x = 0; x < width; x++) {
+    sprite->columnPosts[x] = post;
+    int y = 0;
+    while (y < height) {
+      if (!isOpaque(pixels[y * width + x])) {
+        y++;
+        continue;
+      }
+      int top = y;
+      sprite->posts[post].top = (uint16_t)top;
+      sprite->posts[post].offset = (uint32_t)texel;
+      for (; y < height && isOpaque(pixels[y * width + x]); y++)
+        sprite->postPixels[texel++] = pixels[y * width + x];
+      sprite->posts[post].length = (uint16_t)(y - top);
+      post++;
+    }
+  }
+  sprite->columnPosts[width] = post;
+}
+
 bool loadSprite(Sprite *sprite, const char *filename) {
   int channels;
   unsigned char *data =
@@ -12,6 +65,12 @@ bool loadSprite(Sprite *sprite, const char *filename) {
     printf("Failed to load: %s\n", filename);
     return false;
   }
+  if (sprite->width > SPRITE_MAX_SIZE || sprite->height > SPRITE_MAX_SIZE) {
+    printf("ERROR: %s is bigger than %dx%d\n", filename, SPRITE_MAX_SIZE,
+           SPRITE_MAX_SIZE);
+    stbi_image_free(data);
+    return false;
+  }
 
   sprite->pixels = new uint32_t[sprite->width * sprite->height];
 
@@ -26,173 +85,425 @@ bool loadSprite(Sprite *sprite, const char *filename) {
   }
 
   stbi_image_free(data);
+  buildPosts(sprite);
 
   printf("Loaded %s: %dx%d\n", filename, sprite->width, sprite->height);
   return true;
 }
 
-// Improved sprite scaling - replaces your drawSpriteScaled function
-void drawSpriteScaled(Sprite *sprite, int x, int y, float scale, bool mirror,
-                      uint32_t *pixels, int WIDTH, int HEIGHT) {
-  if (!sprite || !sprite->pixels)
-    return;
+void freeSprite(Sprite *sprite) {
+  delete[] sprite->pixels;
+  delete[] sprite->posts;
+  delete[] sprite->columnPosts;
+  delete[] sprite->postPixels;
+  sprite->pixels = nullptr;
+  sprite->posts = nullptr;
+  sprite->columnPosts = nullptr;
+  sprite->postPixels = nullptr;
+}
 
-  int scaledWidth = (int)(sprite->width * scale + 0.5f);
-  int scaledHeight = (int)(sprite->height * scale + 0.5f);
+// Source positions are stepped in 16.16 fixed point
+#define SPRITE_FRAC_BITS 16
+#define SPRITE_ONE (1 << SPRITE_FRAC_BITS)
 
-  // MODE 1: Sharp pixel art (best for 320x200 Doom-style)
-  // Uses nearest-neighbor but with better rounding
-  for (int sy = 0; sy < scaledHeight; sy++) {
-    for (int sx = 0; sx < scaledWidth; sx++) {
-      // Better sampling: add 0.5 for proper rounding to nearest pixel
-      int origX = (int)((sx + 0.5f) / scale);
-      int origY = (int)((sy + 0.5f) / scale);
+// Destination rows, counting from the one that samples `v`, whose samples
+// are still above `target`
+static inline int rowsBefore(int32_t target, int32_t v, int32_t step) {
+  return target <= v ? 0 : (target - v + step - 1) / step;
+}
 
-      // MIRROR HORIZONTALLY if flag is set
-      if (mirror) {
-        origX = sprite->width - 1 - origX;
-      }
+// Draws one source column into `rows` screen rows starting at dest. The
+// first row samples source row v >> 16 and each one below steps v by
+// `step`. Only the column's posts are visited: the rows between them are
+// skipped without sampling anything. With Fill every pixel the column
+// covers gets `fill` instead of its texel.
+template <bool Fill>
+static inline void drawColumn(const Sprite *sprite, int column, uint32_t *dest,
+                              int pitch, int32_t v, int32_t step, int rows,
+                              uint32_t fill) {
+  int i = 0;
+  for (int p = sprite->columnPosts[column]; p < sprite->columnPosts[column + 1];
+       p++) {
+    const SpritePost &post = sprite->posts[p];
+    int bottom = post.top + post.length;
+    const uint32_t *texels = sprite->postPixels + post.offset - post.top;
+
+    i = std::max(i, rowsBefore(post.top << SPRITE_FRAC_BITS, v, step));
+    int end = std::min(rows, rowsBefore(bottom << SPRITE_FRAC_BITS, v, step));
+
+    int32_t sample = v + i * step;
+    uint32_t *out = dest + i * pitch;
+    for (; i < end; i++, sample += step, out += pitch)
+      *out = Fill ? fill : texels[sample >> SPRITE_FRAC_BITS];
+
+    // Rounding the scaled height up can leave rows past the last source
+    // row; they repeat it
+    if (bottom == sprite->height) {
+      for (; i < rows; i++, out += pitch)
+        *out = Fill ? fill : texels[bottom - 1];
+    }
+    if (i >= rows)
+      return;
+  }
+}
 
-      // Clamp to valid range
-      if (origX >= sprite->width)
-        origX = sprite->width - 1;
-      if (origY >= sprite->height)
-        origY = sprite->height - 1;
-      if (origX < 0 || origY < 0)
-        continue;
+// A sprite blit clipped to the screen
+struct SpriteBlit {
+  int px, py;           // first visible pixel on screen
+  int columns, rows;    // visible size
+  int32_t u, v;         // 16.16 source position sampled there
+  int32_t stepX, stepY; // per destination pixel
+};
+
+// Works out the visible part of the sprite scaled to scaleX by scaleY with
+// its top left at (x, y). False if none of it is on screen.
+static bool clipSpriteBlit(const Sprite *sprite, int x, int y, float scaleX,
+                           float scaleY, const RenderContext *ctx,
+                           SpriteBlit *blit) {
+  int scaledWidth = (int)(sprite->width * scaleX + 0.5f);
+  int scaledHeight = (int)(sprite->height * scaleY + 0.5f);
 
-      uint32_t pixel = sprite->pixels[origY * sprite->width + origX];
-      uint8_t alpha = (pixel >> 24) & 0xFF;
-      if (alpha < 128)
-        continue;
+  // Visible destination rectangle, relative to the sprite's top left
+  int sxBegin = std::max(0, -x);
+  int sxEnd = std::min(scaledWidth, ctx->width - x);
+  int syBegin = std::max(0, -y);
+  int syEnd = std::min(scaledHeight, ctx->height - y);
+  if (sxBegin >= sxEnd || syBegin >= syEnd)
+    return false;
 
-      int px = x + sx;
-      int py = y + sy;
-      if (px >= 0 && px < WIDTH && py >= 0 && py < HEIGHT)
-        pixels[py * WIDTH + px] = pixel;
-    }
+  // Destination pixels sample the source at their centres
+  blit->px = x + sxBegin;
+  blit->py = y + syBegin;
+  blit->columns = sxEnd - sxBegin;
+  blit->rows = syEnd - syBegin;
+  blit->stepX = std::max(1, (int)(SPRITE_ONE / scaleX));
+  blit->stepY = scaleY == scaleX ? blit->stepX
+                                 : std::max(1, (int)(SPRITE_ONE / scaleY));
+  blit->u = (int32_t)((sxBegin + 0.5) * SPRITE_ONE / scaleX);
+  blit->v = (int32_t)((syBegin + 0.5) * SPRITE_ONE / scaleY);
+  return true;
+}
+
+// Source column sampled at u, or -1 if a mirrored sprite has none there
+template <bool Mirror>
+static inline int sourceColumn(int32_t u, int width) {
+  int column = u >> SPRITE_FRAC_BITS;
+  if (column >= width) {
+    if (Mirror)
+      return -1;
+    column = width - 1;
   }
+  return Mirror ? width - 1 - column : column;
 }
 
-void drawSpriteScaledWithDepth(Sprite *sprite, int x, int y, float scale,
-                               bool mirror, uint32_t *pixels, int WIDTH,
-                               int HEIGHT, float *zBuffer, float depth) {
-  if (!sprite || !sprite->pixels)
-    return;
+// Drops the columns at either end of the blit that are behind walls,
+// going by the depth tiles a tile at a time. False if the whole sprite is
+// hidden; *allVisible says the rest needs no per-column depth test.
+static bool occludeSpriteBlit(SpriteBlit *blit, const RenderContext *ctx,
+                              float depth, bool *allVisible) {
+  int x0 = blit->px;
+  int x1 = blit->px + blit->columns;
+  if (!depthTestSpan(ctx, depth, &x0, &x1, allVisible))
+    return false;
 
-  int scaledWidth = (int)(sprite->width * scale + 0.5f);
-  int scaledHeight = (int)(sprite->height * scale + 0.5f);
+  blit->u += (x0 - blit->px) * blit->stepX;
+  blit->px = x0;
+  blit->columns = x1 - x0;
+  return true;
+}
 
-  for (int sy = 0; sy < scaledHeight; sy++) {
-    for (int sx = 0; sx < scaledWidth; sx++) {
-      int origX = (int)((sx + 0.5f) / scale);
-      int origY = (int)((sy + 0.5f) / scale);
+// Draws the blit's columns into the framebuffer or, with Ids, fills the
+// pixels they cover in ctx->entityIds with `id`
+template <bool Mirror, bool DepthTest, bool Ids = false>
+static void drawColumns(const Sprite *sprite, const SpriteBlit &blit,
+                        RenderContext *ctx, float depth, uint32_t id = 0) {
+  int pitch = Ids ? ctx->width : ctx->pitch;
+  uint32_t *dest = (Ids ? ctx->entityIds : ctx->pixels) + blit.py * pitch;
+  int32_t u = blit.u;
+
+  for (int px = blit.px; px < blit.px + blit.columns; px++, u += blit.stepX) {
+    // Z-buffer check: only draw if sprite is closer than wall
+    if (DepthTest && !(depth < ctx->zBuffer[px]))
+      continue;
+
+    int column = sourceColumn<Mirror>(u, sprite->width);
+    if (column >= 0)
+      drawColumn<Ids>(sprite, column, dest + px, pitch, blit.v, blit.stepY,
+                      blit.rows, id);
+  }
+}
 
-      if (mirror) {
-        origX = sprite->width - 1 - origX;
-      }
+// The one column blitter, specialised for each combination of mirroring,
+// depth testing and uniform (scaleY == scaleX) or separate XY scaling, so
+// none of those cost a branch per pixel. Clips the scaled sprite to the
+// screen and, when depth testing, to the columns in front of the walls,
+// then draws each visible column.
+template <bool Mirror, bool DepthTest, bool UniformScale>
+static void blitSprite(const Sprite *sprite, int x, int y, float scaleX,
+                       float scaleY, RenderContext *ctx, float depth) {
+  if (!sprite || !sprite->posts)
+    return;
+  if (UniformScale)
+    scaleY = scaleX;
 
-      if (origX >= sprite->width)
-        origX = sprite->width - 1;
-      if (origY >= sprite->height)
-        origY = sprite->height - 1;
-      if (origX < 0 || origY < 0)
-        continue;
+  SpriteBlit blit;
+  if (!clipSpriteBlit(sprite, x, y, scaleX, scaleY, ctx, &blit))
+    return;
 
-      uint32_t pixel = sprite->pixels[origY * sprite->width + origX];
-      uint8_t alpha = (pixel >> 24) & 0xFF;
-      if (alpha < 128)
-        continue;
+  if (DepthTest) {
+    bool allVisible;
+    if (!occludeSpriteBlit(&blit, ctx, depth, &allVisible))
+      return;
+    if (allVisible) {
+      drawColumns<Mirror, false>(sprite, blit, ctx, depth);
+      return;
+    }
+  }
+  drawColumns<Mirror, DepthTest>(sprite, blit, ctx, depth);
+}
 
-      int px = x + sx;
-      int py = y + sy;
+//
+// SIMD KERNELS FOR THE DEPTH-TESTED BLIT
+//
+
+// Draws `rows` rows of `count` pixels from dest on. columns[j] is the
+// source column for pixel j, or -1 where nothing is drawn, and is padded
+// with -1 to a multiple of 8. The first row samples source row v >> 16
+// and each one below steps v by stepY.
+typedef void (*SpriteRowsFunc)(const Sprite *sprite, const int32_t *columns,
+                               int count, uint32_t *dest, int pitch, int rows,
+                               int32_t v, int32_t stepY);
+
+// Source row sampled at v, repeating the last row for the ones that
+// rounding the scaled height up leaves past it
+static inline const uint32_t *sourceRow(const Sprite *sprite, int32_t v) {
+  int row = std::min(v >> SPRITE_FRAC_BITS, sprite->height - 1);
+  return sprite->pixels + row * sprite->width;
+}
 
-      // Z-buffer check: only draw if sprite is closer than wall
-      if (px >= 0 && px < WIDTH && py >= 0 && py < HEIGHT) {
-        if (depth < zBuffer[px]) {
-          pixels[py * WIDTH + px] = pixel;
-        }
-      }
+#if HAVE_X86_SIMD
+
+// 8 pixels at a time: gather the texels, mask out transparent ones (alpha
+// >= 128 is the sign bit) and hidden columns, and store the rest
+__attribute__((target("avx2"))) static void
+spriteRowsAVX2(const Sprite *sprite, const int32_t *columns, int count,
+               uint32_t *dest, int pitch, int rows, int32_t v, int32_t stepY) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i none = _mm256_set1_epi32(-1);
+
+  for (int r = 0; r < rows; r++, v += stepY, dest += pitch) {
+    const int *src = (const int *)sourceRow(sprite, v);
+    for (int j = 0; j < count; j += 8) {
+      __m256i column = _mm256_loadu_si256((const __m256i *)(columns + j));
+      __m256i visible = _mm256_cmpgt_epi32(column, none);
+      __m256i texels =
+          _mm256_mask_i32gather_epi32(zero, src, column, visible, 4);
+      __m256i opaque = _mm256_cmpgt_epi32(zero, texels);
+      _mm256_maskstore_epi32((int *)(dest + j),
+                             _mm256_and_si256(opaque, visible), texels);
     }
   }
 }
 
-void drawSpriteScaledXY(Sprite *sprite, int x, int y, float scaleX,
-                        float scaleY, bool mirror, uint32_t *pixels, int WIDTH,
-                        int HEIGHT) {
-  if (!sprite || !sprite->pixels)
-    return;
-  int scaledWidth = (int)(sprite->width * scaleX + 0.5f);
-  int scaledHeight = (int)(sprite->height * scaleY + 0.5f);
+// Same idea 4 pixels at a time, without gather: the texels are fetched one
+// lane at a time. With Blend they are blended into what is already on
+// screen, which is only cheap in the context's own, cached framebuffer.
+// Otherwise they go out through a byte mask, so a target that may be a
+// write-combined texture is never read. The last few pixels of each row go
+// one at a time so nothing past the sprite is touched.
+template <bool Blend>
+__attribute__((target("sse4.1"))) static void
+spriteRowsSSE4(const Sprite *sprite, const int32_t *columns, int count,
+               uint32_t *dest, int pitch, int rows, int32_t v, int32_t stepY) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i none = _mm_set1_epi32(-1);
+
+  for (int r = 0; r < rows; r++, v += stepY, dest += pitch) {
+    const uint32_t *src = sourceRow(sprite, v);
+    int j = 0;
+    for (; j + 4 <= count; j += 4) {
+      __m128i column = _mm_loadu_si128((const __m128i *)(columns + j));
+      __m128i visible = _mm_cmpgt_epi32(column, none);
+      column = _mm_max_epi32(column, zero);
+      __m128i texels = _mm_setr_epi32(src[_mm_extract_epi32(column, 0)],
+                                      src[_mm_extract_epi32(column, 1)],
+                                      src[_mm_extract_epi32(column, 2)],
+                                      src[_mm_extract_epi32(column, 3)]);
+      __m128i mask = _mm_and_si128(_mm_cmplt_epi32(texels, zero), visible);
+      __m128i *out = (__m128i *)(dest + j);
+      if (Blend)
+        _mm_storeu_si128(out, _mm_blendv_epi8(_mm_loadu_si128(out), texels,
+                                              mask));
+      else // every lane of mask is all ones or zeros, so it works per byte
+        _mm_maskmoveu_si128(texels, mask, (char *)out);
+    }
+    for (; j < count; j++) {
+      if (columns[j] >= 0 && (src[columns[j]] >> 24) >= 128)
+        dest[j] = src[columns[j]];
+    }
+  }
+  // maskmove stores are non-temporal; order them before the frame is
+  // handed on
+  if (!Blend)
+    _mm_sfence();
+}
 
-  for (int sy = 0; sy < scaledHeight; sy++) {
-    for (int sx = 0; sx < scaledWidth; sx++) {
-      int origX = (int)((sx + 0.5f) / scaleX);
-      int origY = (int)((sy + 0.5f) / scaleY);
+#endif
+
+// Kernel function for `kernel`, or nullptr if this CPU can't run it. The
+// scalar kernel is the column blitter, which isn't a row function.
+static SpriteRowsFunc kernelFunc(SpriteKernel kernel) {
+  switch (kernel) {
+#if HAVE_X86_SIMD
+  case SPRITE_KERNEL_AVX2:
+    return cpuHasAVX2() ? spriteRowsAVX2 : nullptr;
+  case SPRITE_KERNEL_SSE4:
+    return cpuHasSSE41() ? spriteRowsSSE4<false> : nullptr;
+#endif
+  default:
+    return nullptr;
+  }
+}
 
-      if (mirror) {
-        origX = sprite->width - 1 - origX;
-      }
-      if (origX >= sprite->width)
-        origX = sprite->width - 1;
-      if (origY >= sprite->height)
-        origY = sprite->height - 1;
-      if (origX < 0 || origY < 0)
-        continue;
+SpriteKernel bestSpriteKernel() {
+  if (cpuHasAVX2())
+    return SPRITE_KERNEL_AVX2;
+  if (cpuHasSSE41())
+    return SPRITE_KERNEL_SSE4;
+  return SPRITE_KERNEL_SCALAR;
+}
 
-      uint32_t pixel = sprite->pixels[origY * sprite->width + origX];
-      uint8_t alpha = (pixel >> 24) & 0xFF;
-      if (alpha < 128)
-        continue;
+// Picked once at startup; setSpriteKernel is for benchmarks and tests and
+// must not be called while a frame is rendering
+static SpriteKernel activeKernel = bestSpriteKernel();
+static SpriteRowsFunc activeFunc = kernelFunc(activeKernel);
 
-      int px = x + sx;
-      int py = y + sy;
+bool setSpriteKernel(SpriteKernel kernel) {
+  SpriteRowsFunc func = kernelFunc(kernel);
+  if (!func && kernel != SPRITE_KERNEL_SCALAR)
+    return false;
 
-      if (px >= 0 && px < WIDTH && py >= 0 && py < HEIGHT) {
-        pixels[py * WIDTH + px] = pixel;
-      }
-    }
+  activeKernel = kernel;
+  activeFunc = func;
+  return true;
+}
+
+SpriteKernel getSpriteKernel() { return activeKernel; }
+
+const char *spriteKernelName(SpriteKernel kernel) {
+  switch (kernel) {
+  case SPRITE_KERNEL_AVX2:
+    return "AVX2";
+  case SPRITE_KERNEL_SSE4:
+    return "SSE4.1";
+  default:
+    return "scalar";
   }
 }
 
-void drawSpriteScaledWithDepthXY(Sprite *sprite, int x, int y, float scaleX,
-                                 float scaleY, bool mirror, uint32_t *pixels,
-                                 int WIDTH, int HEIGHT, float *zBuffer,
-                                 float depth) {
-  if (!sprite || !sprite->pixels)
+// drawSpriteScaledWithDepth through a row kernel. The depth test and
+// mirroring only depend on the column, so they are done once per blit
+// here, leaving the kernel a per-pixel alpha test.
+template <bool Mirror>
+static void blitSpriteRows(SpriteRowsFunc func, const Sprite *sprite, int x,
+                           int y, float scale, RenderContext *ctx,
+                           float depth) {
+  if (!sprite || !sprite->posts)
+    return;
+
+  SpriteBlit blit;
+  bool allVisible;
+  if (!clipSpriteBlit(sprite, x, y, scale, scale, ctx, &blit) ||
+      !occludeSpriteBlit(&blit, ctx, depth, &allVisible))
     return;
-  int scaledWidth = (int)(sprite->width * scaleX + 0.5f);
-  int scaledHeight = (int)(sprite->height * scaleY + 0.5f);
 
-  for (int sy = 0; sy < scaledHeight; sy++) {
-    for (int sx = 0; sx < scaledWidth; sx++) {
-      int origX = (int)((sx + 0.5f) / scaleX);
-      int origY = (int)((sy + 0.5f) / scaleY);
+  // Source column for each visible screen column, -1 where nothing is
+  // drawn. The clipped blit is at most ctx->width columns, and the
+  // context's scratch has room for that padded to a multiple of 8.
+  int32_t *blitColumns = ctx->spriteColumns;
+  int padded = (blit.columns + 7) & ~7;
 
-      if (mirror) {
-        origX = sprite->width - 1 - origX;
-      }
-      if (origX >= sprite->width)
-        origX = sprite->width - 1;
-      if (origY >= sprite->height)
-        origY = sprite->height - 1;
-      if (origX < 0 || origY < 0)
-        continue;
+  int32_t u = blit.u;
+  for (int j = 0; j < blit.columns; j++, u += blit.stepX) {
+    bool visible = allVisible || depth < ctx->zBuffer[blit.px + j];
+    blitColumns[j] = visible ? sourceColumn<Mirror>(u, sprite->width) : -1;
+  }
+  for (int j = blit.columns; j < padded; j++)
+    blitColumns[j] = -1;
+
+#if HAVE_X86_SIMD
+  // The blend is faster where reading the destination is safe
+  if (func == spriteRowsSSE4<false> && ctx->pixels == ctx->framebuffer)
+    func = spriteRowsSSE4<true>;
+#endif
+  func(sprite, blitColumns, blit.columns,
+       ctx->pixels + blit.py * ctx->pitch + blit.px, ctx->pitch, blit.rows,
+       blit.v, blit.stepY);
+}
 
-      uint32_t pixel = sprite->pixels[origY * sprite->width + origX];
-      uint8_t alpha = (pixel >> 24) & 0xFF;
-      if (alpha < 128)
-        continue;
+// Sharp pixel art (best for 320x200 Doom-style): nearest-neighbour scaling,
+// with texels below half alpha left out
+void drawSpriteScaled(Sprite *sprite, int x, int y, float scale, bool mirror,
+                      RenderContext *ctx) {
+  if (mirror)
+    blitSprite<true, false, true>(sprite, x, y, scale, scale, ctx, 0.0f);
+  else
+    blitSprite<false, false, true>(sprite, x, y, scale, scale, ctx, 0.0f);
+}
 
-      int px = x + sx;
-      int py = y + sy;
+void drawSpriteScaledWithDepth(Sprite *sprite, int x, int y, float scale,
+                               bool mirror, RenderContext *ctx, float depth) {
+  if (activeFunc && mirror)
+    blitSpriteRows<true>(activeFunc, sprite, x, y, scale, ctx, depth);
+  else if (activeFunc)
+    blitSpriteRows<false>(activeFunc, sprite, x, y, scale, ctx, depth);
+  else if (mirror)
+    blitSprite<true, true, true>(sprite, x, y, scale, scale, ctx, depth);
+  else
+    blitSprite<false, true, true>(sprite, x, y, scale, scale, ctx, depth);
+}
 
-      // Z-buffer check: only draw if sprite is closer than wall
-      if (px >= 0 && px < WIDTH && py >= 0 && py < HEIGHT) {
-        if (depth < zBuffer[px]) {
-          pixels[py * WIDTH + px] = pixel;
-        }
-      }
-    }
-  }
+// The ID pass always goes through the column blitter: only the few
+// billboards that can be picked are drawn into it
+template <bool Mirror>
+static void blitSpriteIds(const Sprite *sprite, int x, int y, float scale,
+                          RenderContext *ctx, float depth, uint32_t entry) {
+  if (!sprite || !sprite->posts || !ctx->entityIds)
+    return;
+
+  SpriteBlit blit;
+  bool allVisible;
+  if (!clipSpriteBlit(sprite, x, y, scale, scale, ctx, &blit) ||
+      !occludeSpriteBlit(&blit, ctx, depth, &allVisible))
+    return;
+  if (allVisible)
+    drawColumns<Mirror, false, true>(sprite, blit, ctx, depth, entry);
+  else
+    drawColumns<Mirror, true, true>(sprite, blit, ctx, depth, entry);
+}
+
+void drawSpriteIds(Sprite *sprite, int x, int y, float scale, bool mirror,
+                   RenderContext *ctx, float depth, int id) {
+  uint32_t entry = entityIdEntry(ctx, id);
+  if (mirror)
+    blitSpriteIds<true>(sprite, x, y, scale, ctx, depth, entry);
+  else
+    blitSpriteIds<false>(sprite, x, y, scale, ctx, depth, entry);
+}
+
+void drawSpriteScaledXY(Sprite *sprite, int x, int y, float scaleX,
+                        float scaleY, bool mirror, RenderContext *ctx) {
+  if (mirror)
+    blitSprite<true, false, false>(sprite, x, y, scaleX, scaleY, ctx, 0.0f);
+  else
+    blitSprite<false, false, false>(sprite, x, y, scaleX, scaleY, ctx, 0.0f);
+}
+
+void drawSpriteScaledWithDepthXY(Sprite *sprite, int x, int y, float scaleX,
+                                 float scaleY, bool mirror, RenderContext *ctx,
+                                 float depth) {
+  if (mirror)
+    blitSprite<true, true, false>(sprite, x, y, scaleX, scaleY, ctx, depth);
+  else
+    blitSprite<false, true, false>(sprite, x, y, scaleX, scaleY, ctx, depth);
 }
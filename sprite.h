@@ -1,20 +1,60 @@
 #pragma once
+#include "rendercontext.h"
 #include <cstdint>
+
+// Largest sprite loadSprite accepts along either side, which keeps the
+// blitter's fixed-point source coordinates well inside 32 bits
+#define SPRITE_MAX_SIZE 4096
+
+// A run of opaque texels (alpha >= 128) down one sprite column
+struct SpritePost {
+  uint16_t top;    // first row
+  uint16_t length; // rows
+  uint32_t offset; // first texel in Sprite::postPixels
+};
+
 struct Sprite {
-  uint32_t *pixels;
+  uint32_t *pixels; // ARGB, row-major
   int width;
   int height;
+
+  // Doom patch style copy built by loadSprite, so the blitters never look
+  // at transparent texels: column x is posts[columnPosts[x]] up to
+  // posts[columnPosts[x + 1]], top to bottom, and each post's texels are
+  // stored back to back in postPixels
+  SpritePost *posts;
+  int *columnPosts; // width + 1 entries
+  uint32_t *postPixels;
 };
+
 bool loadSprite(Sprite *sprite, const char *filename);
+void freeSprite(Sprite *sprite);
+
+// Kernels for drawSpriteScaledWithDepth, the blit enemies and projectiles
+// use. The scalar kernel is the column blitter the other variants use; the
+// SSE4.1 and AVX2 kernels draw whole rows 4 or 8 pixels at a time, masking
+// out transparent texels and columns behind walls, and write exactly the
+// same pixels.
+enum SpriteKernel { SPRITE_KERNEL_SCALAR, SPRITE_KERNEL_SSE4,
+                    SPRITE_KERNEL_AVX2 };
+
+SpriteKernel bestSpriteKernel(); // fastest kernel this CPU supports
+bool setSpriteKernel(SpriteKernel kernel); // false if the CPU can't run it
+SpriteKernel getSpriteKernel();
+const char *spriteKernelName(SpriteKernel kernel);
+
+// The WithDepth variants only draw columns where depth < ctx->zBuffer[x]
 void drawSpriteScaled(Sprite *sprite, int x, int y, float scale, bool mirror,
-                      uint32_t *pixels, int WIDTH, int HEIGHT);
+                      RenderContext *ctx);
 void drawSpriteScaledWithDepth(Sprite *sprite, int x, int y, float scale,
-                               bool mirror, uint32_t *pixels, int WIDTH,
-                               int HEIGHT, float *zBuffer, float depth);
+                               bool mirror, RenderContext *ctx, float depth);
 void drawSpriteScaledXY(Sprite *sprite, int x, int y, float scaleX,
-                        float scaleY, bool mirror, uint32_t *pixels, int WIDTH,
-                        int HEIGHT);
+                        float scaleY, bool mirror, RenderContext *ctx);
 void drawSpriteScaledWithDepthXY(Sprite *sprite, int x, int y, float scaleX,
-                                 float scaleY, bool mirror, uint32_t *pixels,
-                                 int WIDTH, int HEIGHT, float *zBuffer,
+                                 float scaleY, bool mirror, RenderContext *ctx,
                                  float depth);
+
+// Writes `id` into ctx->entityIds (see rendercontext.h) under every pixel
+// drawSpriteScaledWithDepth with the same arguments draws
+void drawSpriteIds(Sprite *sprite, int x, int y, float scale, bool mirror,
+                   RenderContext *ctx, float depth, int id);
@@ -0,0 +1,131 @@
+#include "texture.h"
+#include "sprite.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+static bool isPowerOfTwo(int n) { return n > 0 && (n & (n - 1)) == 0; }
+
+bool createTexture(Texture *tex, const uint32_t *argb, int width, int height,
+                   TextureLayout layout) {
+  if (!argb || width <= 0 || height <= 0)
+    return false;
+
+  tex->pixels = new uint32_t[width * height];
+  tex->width = width;
+  tex->height = height;
+  tex->layout = layout;
+  tex->powerOfTwo = isPowerOfTwo(width) && isPowerOfTwo(height);
+  tex->widthMask = width - 1;
+  tex->heightMask = height - 1;
+
+  if (layout == TEXTURE_COLUMN_MAJOR) {
+    // Transpose so every texture column is contiguous
+    for (int y = 0; y < height; y++)
+      for (int x = 0; x < width; x++)
+        tex->pixels[x * height + y] = argb[y * width + x];
+  } else {
+    for (int i = 0; i < width * height; i++)
+      tex->pixels[i] = argb[i];
+  }
+
+  return true;
+}
+
+bool loadTexture(Texture *tex, const char *filename, TextureLayout layout) {
+  Sprite image;
+  if (!loadSprite(&image, filename))
+    return false;
+
+  bool ok = createTexture(tex, image.pixels, image.width, image.height, layout);
+  freeSprite(&image);
+
+  if (ok && !tex->powerOfTwo)
+    printf("Note: %s is not a power of two, texture coords will be clamped\n",
+           filename);
+  return ok;
+}
+
+void freeTexture(Texture *tex) {
+  if (tex->pixels) {
+    delete[] tex->pixels;
+    tex->pixels = nullptr;
+  }
+}
+
+// Halves a row-major image with a 2x2 box filter. Odd edges reuse the last
+// row/column so non power-of-two sizes still work.
+static void downsample(const std::vector<uint32_t> &src, int width, int height,
+                       std::vector<uint32_t> &dst, int dstWidth,
+                       int dstHeight) {
+  dst.resize(dstWidth * dstHeight);
+
+  for (int y = 0; y < dstHeight; y++) {
+    int y0 = std::min(y * 2, height - 1);
+    int y1 = std::min(y * 2 + 1, height - 1);
+
+    for (int x = 0; x < dstWidth; x++) {
+      int x0 = std::min(x * 2, width - 1);
+      int x1 = std::min(x * 2 + 1, width - 1);
+
+      uint32_t a = src[y0 * width + x0];
+      uint32_t b = src[y0 * width + x1];
+      uint32_t c = src[y1 * width + x0];
+      uint32_t d = src[y1 * width + x1];
+
+      uint32_t out = 0;
+      for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t sum = ((a >> shift) & 0xFF) + ((b >> shift) & 0xFF) +
+                       ((c >> shift) & 0xFF) + ((d >> shift) & 0xFF);
+        out |= ((sum + 2) / 4) << shift;
+      }
+      dst[y * dstWidth + x] = out;
+    }
+  }
+}
+
+bool createMipTexture(MipTexture *mip, const uint32_t *argb, int width,
+                      int height, TextureLayout layout) {
+  mip->levelCount = 0;
+  if (!argb || width <= 0 || height <= 0)
+    return false;
+
+  std::vector<uint32_t> current(argb, argb + width * height);
+  std::vector<uint32_t> next;
+
+  for (;;) {
+    Texture &level = mip->levels[mip->levelCount];
+    createTexture(&level, current.data(), width, height, layout);
+    mip->levelCount++;
+
+    if ((width == 1 && height == 1) || mip->levelCount == MAX_MIP_LEVELS)
+      break;
+
+    int nextWidth = std::max(width / 2, 1);
+    int nextHeight = std::max(height / 2, 1);
+    downsample(current, width, height, next, nextWidth, nextHeight);
+    current.swap(next);
+    width = nextWidth;
+    height = nextHeight;
+  }
+
+  return true;
+}
+
+bool loadMipTexture(MipTexture *mip, const char *filename,
+                    TextureLayout layout) {
+  Sprite image;
+  if (!loadSprite(&image, filename))
+    return false;
+
+  bool ok = createMipTexture(mip, image.pixels, image.width, image.height,
+                             layout);
+  freeSprite(&image);
+  return ok;
+}
+
+void freeMipTexture(MipTexture *mip) {
+  for (int i = 0; i < mip->levelCount; i++)
+    freeTexture(&mip->levels[i]);
+  mip->levelCount = 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+
+// How texels are stored. Walls are drawn a screen column at a time, which
+// walks a texture column, so column-major storage keeps those reads
+// contiguous. Floors and ceilings are drawn along rows and stay row-major.
+enum TextureLayout { TEXTURE_ROW_MAJOR, TEXTURE_COLUMN_MAJOR };
+
+struct Texture {
+  uint32_t *pixels; // ARGB
+  int width;
+  int height;
+  TextureLayout layout;
+  bool powerOfTwo; // both sides are powers of two, so coords can be masked
+  int widthMask;   // width - 1
+  int heightMask;  // height - 1
+};
+
+// Copies row-major ARGB pixels into a texture with the requested layout
+bool createTexture(Texture *tex, const uint32_t *argb, int width, int height,
+                   TextureLayout layout);
+bool loadTexture(Texture *tex, const char *filename, TextureLayout layout);
+void freeTexture(Texture *tex);
+
+// Address of texel (x, y) and the distance between texels (x, y) and
+// (x, y + 1), so a vertical slice can be walked in either layout
+inline const uint32_t *texelAddress(const Texture *tex, int x, int y) {
+  if (tex->layout == TEXTURE_COLUMN_MAJOR)
+    return tex->pixels + x * tex->height + y;
+  return tex->pixels + y * tex->width + x;
+}
+
+inline int columnStride(const Texture *tex) {
+  return tex->layout == TEXTURE_COLUMN_MAJOR ? 1 : tex->width;
+}
+
+#define MAX_MIP_LEVELS 16
+
+// A texture plus box-filtered copies at half, quarter, ... size, down to
+// 1x1. Distant surfaces sample a smaller level so they touch less memory
+// and alias less.
+struct MipTexture {
+  Texture levels[MAX_MIP_LEVELS]; // level 0 is full size
+  int levelCount;
+};
+
+bool createMipTexture(MipTexture *mip, const uint32_t *argb, int width,
+                      int height, TextureLayout layout);
+bool loadMipTexture(MipTexture *mip, const char *filename,
+                    TextureLayout layout);
+void freeMipTexture(MipTexture *mip);
+
+// Level to sample when one screen pixel covers `texelsPerPixel` texels of
+// level 0 (the largest level whose texels are still no bigger than a pixel)
+inline int mipLevelFor(const MipTexture *mip, float texelsPerPixel) {
+  int level = 0;
+  while (level + 1 < mip->levelCount && texelsPerPixel >= 2.0f) {
+    texelsPerPixel *= 0.5f;
+    level++;
+  }
+  return level;
+}
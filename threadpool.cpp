@@ -0,0 +1,117 @@
+#include "threadpool.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static std::vector<std::thread> workers;
+static std::mutex poolMutex;
+static std::condition_variable wakeCond;
+static std::condition_variable doneCond;
+
+// Current batch - only written by runParallel while every worker is idle
+static ParallelJob currentJob = nullptr;
+static void *currentData = nullptr;
+static int currentJobCount = 0;
+static std::atomic<int> nextJob(0);
+
+static unsigned generation = 0; // bumped once per batch to wake the workers
+static int busyWorkers = 0;
+static bool stopping = false;
+
+static void drainJobs() {
+  for (;;) {
+    int i = nextJob.fetch_add(1, std::memory_order_relaxed);
+    if (i >= currentJobCount)
+      break;
+    currentJob(currentData, i);
+  }
+}
+
+// seen starts at the generation current when the worker was spawned, so a
+// batch finished before a stop/start is never mistaken for new work
+static void workerLoop(unsigned seen) {
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(poolMutex);
+      wakeCond.wait(lock, [&] { return stopping || generation != seen; });
+      if (stopping)
+        return;
+      seen = generation;
+    }
+
+    drainJobs();
+
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (busyWorkers > 0 && --busyWorkers == 0)
+      doneCond.notify_one();
+  }
+}
+
+bool startThreadPool(int threadCount) {
+  stopThreadPool();
+
+  if (threadCount < 1)
+    threadCount = 1;
+
+  unsigned current;
+  {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    stopping = false;
+    current = generation;
+  }
+  // The caller is thread 0, so we only spawn threadCount - 1 workers
+  for (int i = 1; i < threadCount; i++) {
+    try {
+      workers.emplace_back(workerLoop, current);
+    } catch (...) {
+      printf("WARNING: Could only start %d render threads\n", i);
+      break;
+    }
+  }
+  return true;
+}
+
+void stopThreadPool() {
+  if (workers.empty())
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    stopping = true;
+  }
+  wakeCond.notify_all();
+
+  for (std::thread &t : workers)
+    t.join();
+  workers.clear();
+}
+
+int getThreadPoolSize() { return (int)workers.size() + 1; }
+
+void runParallel(ParallelJob job, void *userData, int jobCount) {
+  if (workers.empty() || jobCount <= 1) {
+    for (int i = 0; i < jobCount; i++)
+      job(userData, i);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(poolMutex);
+    currentJob = job;
+    currentData = userData;
+    currentJobCount = jobCount;
+    nextJob.store(0, std::memory_order_relaxed);
+    busyWorkers = (int)workers.size();
+    generation++;
+  }
+  wakeCond.notify_all();
+
+  drainJobs();
+
+  // Wait for stragglers so the next batch can't overwrite a job in flight
+  std::unique_lock<std::mutex> lock(poolMutex);
+  doneCond.wait(lock, [] { return busyWorkers == 0; });
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+// Persistent worker pool used by the renderer. Workers are started once and
+// sleep between frames; the calling thread always takes part in the work.
+typedef void (*ParallelJob)(void *userData, int jobIndex);
+
+bool startThreadPool(int threadCount); // threadCount includes the caller
+void stopThreadPool();
+int getThreadPoolSize();
+
+// Runs job(userData, i) for every i in [0, jobCount) and returns once all of
+// them have finished. Jobs are handed out dynamically, so uneven jobs balance.
+void runParallel(ParallelJob job, void *userData, int jobCount);
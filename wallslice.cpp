@@ -0,0 +1,181 @@
+#include "wallslice.h"
+#include "cpu.h"
+#include "lighting.h"
+
+#if HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+typedef void (*WallSliceFunc)(uint32_t *dst, int dstStride, int count,
+                              const uint32_t *texColumn, int texPos,
+                              int texStep, int heightMask, int level);
+
+// Reference kernel - the SIMD ones must match it bit for bit
+static void wallSliceScalar(uint32_t *dst, int dstStride, int count,
+                            const uint32_t *texColumn, int texPos,
+                            int texStep, int heightMask, int level) {
+  const uint8_t *light = lightTable[level].data();
+
+  for (int i = 0; i < count; i++) {
+    *dst = applyLight(texColumn[(texPos >> 16) & heightMask], light);
+    dst += dstStride;
+    texPos = (int)((unsigned)texPos + (unsigned)texStep);
+  }
+}
+
+// texPos after `steps` steps, wrapping the same way the scalar loop does
+static inline int advanceTexPos(int texPos, int texStep, int steps) {
+  return (int)((unsigned)texPos + (unsigned)texStep * (unsigned)steps);
+}
+
+#if HAVE_X86_SIMD
+
+// 8 pixels per iteration: gather 8 texels, shade all 32 channels with
+// 16-bit multiplies ((c * lightScale) >> 8 is exactly lightTable), then
+// write them down the column
+__attribute__((target("avx2"))) static void
+wallSliceAVX2(uint32_t *dst, int dstStride, int count,
+              const uint32_t *texColumn, int texPos, int texStep,
+              int heightMask, int level) {
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i mask = _mm256_set1_epi32(heightMask);
+  const __m256i scale = _mm256_set1_epi16((short)lightScale(level));
+  const __m256i alpha = _mm256_set1_epi32((int)0xFF000000u);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i step8 = _mm256_set1_epi32(advanceTexPos(0, texStep, 8));
+
+  __m256i pos = _mm256_add_epi32(
+      _mm256_set1_epi32(texPos),
+      _mm256_mullo_epi32(lanes, _mm256_set1_epi32(texStep)));
+
+  alignas(32) uint32_t shaded[8];
+  int i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i texY = _mm256_and_si256(_mm256_srai_epi32(pos, 16), mask);
+    __m256i texels =
+        _mm256_i32gather_epi32((const int *)texColumn, texY, 4);
+
+    __m256i lo = _mm256_unpacklo_epi8(texels, zero);
+    __m256i hi = _mm256_unpackhi_epi8(texels, zero);
+    lo = _mm256_srli_epi16(_mm256_mullo_epi16(lo, scale), 8);
+    hi = _mm256_srli_epi16(_mm256_mullo_epi16(hi, scale), 8);
+    __m256i out = _mm256_or_si256(_mm256_packus_epi16(lo, hi), alpha);
+
+    _mm256_store_si256((__m256i *)shaded, out);
+    for (int j = 0; j < 8; j++) {
+      *dst = shaded[j];
+      dst += dstStride;
+    }
+
+    pos = _mm256_add_epi32(pos, step8);
+  }
+
+  wallSliceScalar(dst, dstStride, count - i, texColumn,
+                  advanceTexPos(texPos, texStep, i), texStep, heightMask,
+                  level);
+}
+
+// Same idea 4 pixels at a time, without a gather instruction
+__attribute__((target("sse4.1"))) static void
+wallSliceSSE4(uint32_t *dst, int dstStride, int count,
+              const uint32_t *texColumn, int texPos, int texStep,
+              int heightMask, int level) {
+  const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+  const __m128i mask = _mm_set1_epi32(heightMask);
+  const __m128i scale = _mm_set1_epi16((short)lightScale(level));
+  const __m128i alpha = _mm_set1_epi32((int)0xFF000000u);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i step4 = _mm_set1_epi32(advanceTexPos(0, texStep, 4));
+
+  __m128i pos = _mm_add_epi32(_mm_set1_epi32(texPos),
+                              _mm_mullo_epi32(lanes, _mm_set1_epi32(texStep)));
+
+  int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i texY = _mm_and_si128(_mm_srai_epi32(pos, 16), mask);
+    __m128i texels = _mm_setr_epi32(
+        texColumn[_mm_extract_epi32(texY, 0)],
+        texColumn[_mm_extract_epi32(texY, 1)],
+        texColumn[_mm_extract_epi32(texY, 2)],
+        texColumn[_mm_extract_epi32(texY, 3)]);
+
+    __m128i lo = _mm_unpacklo_epi8(texels, zero);
+    __m128i hi = _mm_unpackhi_epi8(texels, zero);
+    lo = _mm_srli_epi16(_mm_mullo_epi16(lo, scale), 8);
+    hi = _mm_srli_epi16(_mm_mullo_epi16(hi, scale), 8);
+    __m128i out = _mm_or_si128(_mm_packus_epi16(lo, hi), alpha);
+
+    dst[0] = (uint32_t)_mm_extract_epi32(out, 0);
+    dst[dstStride] = (uint32_t)_mm_extract_epi32(out, 1);
+    dst[dstStride * 2] = (uint32_t)_mm_extract_epi32(out, 2);
+    dst[dstStride * 3] = (uint32_t)_mm_extract_epi32(out, 3);
+    dst += dstStride * 4;
+
+    pos = _mm_add_epi32(pos, step4);
+  }
+
+  wallSliceScalar(dst, dstStride, count - i, texColumn,
+                  advanceTexPos(texPos, texStep, i), texStep, heightMask,
+                  level);
+}
+
+#endif
+
+// Kernel function for `kernel`, or nullptr if this CPU can't run it
+static WallSliceFunc kernelFunc(WallKernel kernel) {
+  switch (kernel) {
+#if HAVE_X86_SIMD
+  case WALL_KERNEL_AVX2:
+    return cpuHasAVX2() ? wallSliceAVX2 : nullptr;
+  case WALL_KERNEL_SSE4:
+    return cpuHasSSE41() ? wallSliceSSE4 : nullptr;
+#endif
+  case WALL_KERNEL_SCALAR:
+    return wallSliceScalar;
+  default:
+    return nullptr;
+  }
+}
+
+WallKernel bestWallKernel() {
+  if (cpuHasAVX2())
+    return WALL_KERNEL_AVX2;
+  if (cpuHasSSE41())
+    return WALL_KERNEL_SSE4;
+  return WALL_KERNEL_SCALAR;
+}
+
+// Picked once at startup; setWallKernel is for benchmarks and tests and
+// must not be called while a frame is rendering
+static WallKernel activeKernel = bestWallKernel();
+static WallSliceFunc activeFunc = kernelFunc(activeKernel);
+
+bool setWallKernel(WallKernel kernel) {
+  WallSliceFunc func = kernelFunc(kernel);
+  if (!func)
+    return false;
+
+  activeKernel = kernel;
+  activeFunc = func;
+  return true;
+}
+
+WallKernel getWallKernel() { return activeKernel; }
+
+const char *wallKernelName(WallKernel kernel) {
+  switch (kernel) {
+  case WALL_KERNEL_AVX2:
+    return "AVX2";
+  case WALL_KERNEL_SSE4:
+    return "SSE4.1";
+  default:
+    return "scalar";
+  }
+}
+
+void drawWallSlice(uint32_t *dst, int dstStride, int count,
+                   const uint32_t *texColumn, int texPos, int texStep,
+                   int heightMask, int level) {
+  activeFunc(dst, dstStride, count, texColumn, texPos, texStep, heightMask,
+             level);
+}
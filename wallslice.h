@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+
+// Inner wall loop: draws `count` pixels down a screen column from one
+// column of a column-major, power-of-two texture, shading them with light
+// level `level`. texPos and texStep are 16.16 texture rows.
+//
+// The SSE4.1 and AVX2 kernels shade with packed 16-bit multiplies that give
+// exactly the values in lightTable, so every kernel writes the same pixels
+// as the scalar one.
+enum WallKernel { WALL_KERNEL_SCALAR, WALL_KERNEL_SSE4, WALL_KERNEL_AVX2 };
+
+WallKernel bestWallKernel();         // fastest kernel this CPU supports
+bool setWallKernel(WallKernel kernel); // false if the CPU can't run it
+WallKernel getWallKernel();
+const char *wallKernelName(WallKernel kernel);
+
+void drawWallSlice(uint32_t *dst, int dstStride, int count,
+                   const uint32_t *texColumn, int texPos, int texStep,
+                   int heightMask, int level);